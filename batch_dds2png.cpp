@@ -5,34 +5,284 @@
 #include <filesystem>
 #include <string>
 #include <vector>
-#include <queue>
 #include <thread>
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <memory>
 #include <iostream>
 #include <iomanip>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <system_error>
+#include <unordered_set>
+
+#include <zlib.h>
+
+#include "dds2png.h"
+#include "file_io.h"
+#include "manifest.h"
 
 namespace fs = std::filesystem;
 
-// External converter:
-extern "C" int dds2png_convert(const char* inPath, const char* outPath);
+#define NO_JOB SIZE_MAX
 
 // Job entry
 struct Job {
     std::string dds;
     std::string png;
+    std::string partPng;   // written here, renamed to png once complete
+    std::string benchPng;  // scratch output of the --bench I/O comparison
+    std::string key;       // manifest key: dds relative to the root
+    uint64_t ddsBytes = 0; // size of the DDS file when scanned
+    int64_t ddsMtime = 0;  // its mtime then, as from statFile()
+    uint32_t ddsCrc = 0;   // crc32 of the DDS
+    bool hashed = false;   // ddsCrc is set
+    size_t copyOf = NO_JOB; // same DDS contents as that job: clone its PNG
+    uint32_t dxgi = 0;     // from the header probe; 0 if it failed
+    double estMs = 0.0;    // estimated single-core cost
+    double actualMs = 0.0; // measured by the worker that ran it
+    int worker = -1;       // dealt to this worker by the live scan
+};
+
+// ------------- WORK-STEALING DEQUE -------------
+// Chase-Lev deque of job indices (Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models", 2013). The owning worker pushes and
+// pops at the bottom; idle workers steal from the top. Only the last item
+// is ever contended, so workers with their own jobs never touch a shared
+// cache line. The ring does not grow: a planned run sizes it for every job
+// it will get, a live one keeps it at LIVE_DEQUE_JOBS (see refillDeque).
+class JobDeque {
+public:
+    enum Result { Empty, Taken, Lost };
+
+    explicit JobDeque(size_t capacity)
+    {
+        size_t n = 1;
+        while (n < capacity) n <<= 1;
+        ring.reset(new std::atomic<size_t>[n]);
+        mask = n - 1;
+    }
+
+    // Owner only: free places left. Thieves only ever make it larger.
+    size_t room() const
+    {
+        int64_t used = bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_acquire);
+        return mask + 1 - (size_t)std::max<int64_t>(used, 0);
+    }
+
+    // Owner only.
+    void push(size_t job)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        ring[(size_t)b & mask].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only: newest job first.
+    Result pop(size_t& job)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return Empty;
+        }
+        job = ring[(size_t)b & mask].load(std::memory_order_relaxed);
+        if (t < b)
+            return Taken;
+
+        // Last job: race the thieves for it.
+        bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return won ? Taken : Empty;
+    }
+
+    // Any thread: oldest job first. Lost means another thread got there
+    // first and the deque may still hold work.
+    Result steal(size_t& job)
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return Empty;
+
+        job = ring[(size_t)t & mask].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return Lost;
+        return Taken;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::unique_ptr<std::atomic<size_t>[]> ring;
+    size_t mask = 0;
 };
 
-// Global job queue
-std::queue<Job> jobQueue;
-std::mutex queueMutex;
-std::condition_variable queueCV;
+// ------------- JOB LIST -------------
+// Append-only storage in chunks: a job never moves once added, so workers
+// can use jobs while the scan is still appending. Chunk k holds 4096 << k
+// jobs, so a fixed table of chunk pointers covers any count and the list
+// never holds more than twice what it uses. The scanner threads append
+// under a lock; a job's index reaches a worker only through a queue that
+// orders the two.
+class JobList {
+public:
+    size_t push(Job&& job)
+    {
+        std::lock_guard<std::mutex> lk(m);
+        size_t i = count.load(std::memory_order_relaxed);
+        size_t k, slot;
+        locate(i, k, slot);
+        if (!chunks[k])
+            chunks[k].reset(new Job[(size_t)1 << (k + FIRST_CHUNK_SHIFT)]);
+        chunks[k][slot] = std::move(job);
+        count.store(i + 1, std::memory_order_release);
+        return i;
+    }
+
+    Job& operator[](size_t i)
+    {
+        size_t k, slot;
+        locate(i, k, slot);
+        return chunks[k][slot];
+    }
+
+    size_t size() const { return count.load(std::memory_order_acquire); }
+
+private:
+    static constexpr unsigned FIRST_CHUNK_SHIFT = 12;
+
+    // Offset by the first chunk's size, chunk k covers [4096 << k,
+    // 8192 << k): the top bit picks the chunk, the bits below it the slot
+    static void locate(size_t i, size_t& k, size_t& slot)
+    {
+        const unsigned long long b = (unsigned long long)i + (1ull << FIRST_CHUNK_SHIFT);
+        const unsigned top = 63u - (unsigned)__builtin_clzll(b);
+        k = top - FIRST_CHUNK_SHIFT;
+        slot = (size_t)(b - (1ull << top));
+    }
+
+    std::mutex m;
+    std::unique_ptr<Job[]> chunks[64 - FIRST_CHUNK_SHIFT];
+    std::atomic<size_t> count{0};
+};
 
-std::atomic<bool> done(false);
-std::atomic<int> jobsTotal(0);
+// Jobs of the current run; workers refer to them by index and never copy them
+JobList jobList;
+
+// ------------- WORKER QUEUES -------------
+// Each worker owns a JobDeque. A planned run (--bench) fills the deques up
+// front (planJobs). During a live scan, each job found is dealt to the inbox
+// of the worker with the least estimated work outstanding, the rule planJobs
+// applies offline; the worker moves its inbox into its deque, biggest jobs
+// on top, and an idle worker that finds every deque empty takes the biggest
+// job from another worker's inbox. Every inbox has its own lock.
+#define LIVE_DEQUE_JOBS 1024
+
+struct WorkerQueue {
+    std::unique_ptr<JobDeque> deque;
+    std::mutex inboxMutex;
+    std::vector<size_t> inbox;      // dealt by the scan, not yet in the deque
+    std::atomic<int64_t> loadUs{0}; // estimate of the dealt jobs not finished
+};
+
+std::vector<std::unique_ptr<WorkerQueue>> workerQueues; // one per worker
+std::atomic<int> jobsWaiting(0);   // queued for the workers, not yet taken
+std::atomic<int> workersParked(0); // in waitForWork(): wake them for new jobs
+
+std::atomic<bool> scanning(false); // the scan may still add jobs
+std::atomic<int> jobsTotal(0);     // jobs found so far
 std::atomic<int> jobsFinished(0);
+double plannedMakespanMs = 0.0; // largest per-worker estimate of the last run
+
+// Estimated cost from which a job is split even while other jobs remain
+#define SPLIT_MIN_MS 50.0
+
+// Compression settings shared by every job
+dds2png_options convertOptions;
+int workerCount = 1;
+bool benchMode = false; // --bench: no output files, no progress bar
+bool pipelineMode = false; // --pipeline: separate read / convert / write stages
+bool benchWrites = false; // --bench I/O comparison: write PNGs to Job::benchPng
+bool statsMode = false; // --stats: report the decoders' fast-path counters
+std::unique_ptr<FileIO> fileIO; // pipeline reads and writes
+
+// What earlier runs converted (manifest.h); not used by --bench
+Manifest manifest;
+bool manifestFresh = false;  // the root had no manifest: adopt existing PNGs
+uint32_t settingsHash = 0;   // manifestSettings(convertOptions)
+
+// ------------- SHARED SUBTASK POOL -------------
+// A conversion splits into subtasks (block-row bands to decode, deflate
+// segments to compress) through dds2png_options::parallel_for. The worker
+// running it publishes the subtasks here and runs them itself; workers that
+// are out of jobs help with them instead of exiting. Once the owner has run
+// out of subtasks it unlists the group and sleeps until the last helper
+// leaves: every subtask a helper took is finished by then.
+struct TaskGroup {
+    dds2png_task_fn fn;
+    void* arg;
+    size_t count;
+    std::atomic<size_t> next{0};
+    std::atomic<int> helpers{0}; // workers other than the owner inside drainGroup
+    std::mutex m;                // the last helper out signals cv under m
+    std::condition_variable cv;
+};
+
+std::mutex groupMutex;             // guards openGroups and foundJobs; idle workers park on groupCV
+std::condition_variable groupCV;
+std::vector<TaskGroup*> openGroups;
+
+// --pipeline: jobs the scan has found and no reader has started, biggest
+// estimate on top, so the read stage loads the most expensive job seen so far.
+std::priority_queue<std::pair<double, size_t>> foundJobs;
+
+static void drainGroup(TaskGroup* g)
+{
+    for (;;) {
+        size_t i = g->next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= g->count)
+            return;
+        g->fn(g->arg, i);
+    }
+}
+
+static void poolParallelFor(void* /*pool*/, int /*threads*/, size_t count, dds2png_task_fn fn, void* arg)
+{
+    TaskGroup g;
+    g.fn = fn;
+    g.arg = arg;
+    g.count = count;
+
+    {
+        std::lock_guard<std::mutex> lk(groupMutex);
+        openGroups.push_back(&g);
+    }
+    groupCV.notify_all();
+
+    drainGroup(&g);
+
+    // No helper can join once the group is unlisted; wait out the ones inside.
+    {
+        std::lock_guard<std::mutex> lk(groupMutex);
+        openGroups.erase(std::find(openGroups.begin(), openGroups.end(), &g));
+    }
+    std::unique_lock<std::mutex> lk(g.m);
+    g.cv.wait(lk, [&g] { return g.helpers.load(std::memory_order_acquire) == 0; });
+}
 
 // ------------- ANSI COLORS (HEV ORANGE + ACCENTS) -------------
 #define ORANGE   "\033[38;2;255;150;30m"
@@ -75,6 +325,10 @@ static void hev_startup()
 // ------------- HEV THEMED PROGRESS BAR -------------
 static void hev_progress()
 {
+    // workers and scanners all report; one line at a time
+    static std::mutex progressMutex;
+    std::lock_guard<std::mutex> lk(progressMutex);
+
     int doneCount = jobsFinished.load();
     int total = jobsTotal.load();
     if (total == 0) return;
@@ -100,34 +354,1231 @@ static void hev_progress()
     std::cout << std::flush;
 }
 
+// Live scan: give job `index` to the worker with the least outstanding
+// estimate, and wake parked workers.
+static void dealJob(size_t index)
+{
+    Job& j = jobList[index];
+    int best = 0;
+    int64_t bestLoad = INT64_MAX;
+    for (int w = 0; w < workerCount; w++) {
+        int64_t load = workerQueues[w]->loadUs.load(std::memory_order_relaxed);
+        if (load < bestLoad) {
+            bestLoad = load;
+            best = w;
+        }
+    }
+    j.worker = best;
+    WorkerQueue& q = *workerQueues[best];
+    q.loadUs.fetch_add((int64_t)(j.estMs * 1000.0), std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lk(q.inboxMutex);
+        q.inbox.push_back(index);
+    }
+
+    // Pairs with waitForWork(): a worker either sees the job or is counted
+    jobsWaiting.fetch_add(1);
+    if (workersParked.load() > 0) {
+        { std::lock_guard<std::mutex> lk(groupMutex); }
+        groupCV.notify_all();
+    }
+}
+
+// Move the biggest jobs of the worker's inbox into its deque, as many as fit,
+// pushed smallest first so the owner pops the biggest and thieves take the
+// small ones.
+static void refillDeque(WorkerQueue& q)
+{
+    std::lock_guard<std::mutex> lk(q.inboxMutex);
+    if (q.inbox.empty())
+        return;
+    std::sort(q.inbox.begin(), q.inbox.end(), [](size_t a, size_t b) {
+        return jobList[a].estMs < jobList[b].estMs;
+    });
+    size_t n = std::min(q.inbox.size(), q.deque->room());
+    for (size_t i = q.inbox.size() - n; i < q.inbox.size(); i++)
+        q.deque->push(q.inbox[i]);
+    q.inbox.resize(q.inbox.size() - n);
+}
+
+// The biggest job in another worker's inbox, for a worker that found every
+// deque empty.
+static bool takeFromInbox(WorkerQueue& q, size_t& job)
+{
+    std::lock_guard<std::mutex> lk(q.inboxMutex);
+    if (q.inbox.empty())
+        return false;
+    auto it = std::max_element(q.inbox.begin(), q.inbox.end(), [](size_t a, size_t b) {
+        return jobList[a].estMs < jobList[b].estMs;
+    });
+    job = *it;
+    q.inbox.erase(it);
+    return true;
+}
+
 // ------------- WORKER THREAD -------------
-void workerThread(int id)
+// Own inbox into own deque, own deque, then steal round-robin from the other
+// deques, then from the other inboxes. False means nothing is queued right
+// now; while the scan runs, more may come.
+static bool nextJob(int id, size_t& job)
 {
+    WorkerQueue& own = *workerQueues[id];
+    refillDeque(own);
+    bool taken = own.deque->pop(job) == JobDeque::Taken;
+
+    while (!taken) {
+        bool lost = false;
+        for (int k = 1; k < workerCount && !taken; k++) {
+            JobDeque::Result r = workerQueues[(id + k) % workerCount]->deque->steal(job);
+            taken = r == JobDeque::Taken;
+            lost |= (r == JobDeque::Lost);
+        }
+        if (!lost)
+            break;
+    }
+    for (int k = 1; k < workerCount && !taken; k++)
+        taken = takeFromInbox(*workerQueues[(id + k) % workerCount], job);
+
+    if (taken)
+        jobsWaiting.fetch_sub(1);
+    return taken;
+}
+
+static bool allJobsDone()
+{
+    return !scanning.load() && jobsFinished.load() == jobsTotal.load();
+}
+
+// Out of jobs: help with other workers' subtasks until the scan finds a new
+// job (returns true; only when takeJobs) or every job is done (false).
+static bool waitForWork(bool takeJobs)
+{
+    std::unique_lock<std::mutex> lk(groupMutex);
     for (;;) {
-        Job job;
+        TaskGroup* g = nullptr;
+        bool found = false;
+        workersParked.fetch_add(1);
+        groupCV.wait(lk, [&g, &found, takeJobs] {
+            for (TaskGroup* open : openGroups) {
+                if (open->next.load(std::memory_order_relaxed) < open->count) {
+                    g = open;
+                    return true;
+                }
+            }
+            found = takeJobs && jobsWaiting.load() > 0;
+            return found || allJobsDone();
+        });
+        workersParked.fetch_sub(1);
+        if (found)
+            return true;
+        if (!g)
+            return false;
 
-        // fetch job
+        g->helpers.fetch_add(1, std::memory_order_relaxed);
+        lk.unlock();
+        drainGroup(g);
         {
-            std::unique_lock<std::mutex> lk(queueMutex);
-            queueCV.wait(lk, [] {
-                return !jobQueue.empty() || done.load();
-            });
+            // Under g->m, so the owner cannot return (and free g) before
+            // this is done with it
+            std::lock_guard<std::mutex> gl(g->m);
+            if (g->helpers.fetch_sub(1, std::memory_order_release) == 1)
+                g->cv.notify_one();
+        }
+        lk.lock();
+    }
+}
 
-            if (jobQueue.empty()) {
-                if (done.load()) return;
-                continue;
+static void helpUntilDone()
+{
+    waitForWork(false);
+}
+
+// Options for one job: big textures, and every texture once fewer jobs
+// remain than workers, are split into subtasks that idle workers pick up
+// from the shared pool.
+static dds2png_options jobOptions(const Job& job)
+{
+    dds2png_options opts = convertOptions;
+    int remaining = scanning.load() ? workerCount : jobsTotal.load() - jobsFinished.load();
+    if (workerCount > 1 && (remaining < workerCount || job.estMs >= SPLIT_MIN_MS)) {
+        opts.threads = workerCount;
+        opts.parallel_for = poolParallelFor;
+    }
+    return opts;
+}
+
+static double msSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static uint32_t crcBytes(const uint8_t* data, size_t size)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    while (size > 0) {
+        uInt n = (uInt)std::min(size, (size_t)1 << 30);
+        crc = crc32(crc, data, n);
+        data += n;
+        size -= n;
+    }
+    return (uint32_t)crc;
+}
+
+static bool crcFile(const std::string& path, uint32_t& crc)
+{
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    std::vector<uint8_t> buf(1 << 20);
+    uLong c = crc32(0L, Z_NULL, 0);
+    size_t n;
+    while ((n = std::fread(buf.data(), 1, buf.size(), f)) > 0)
+        c = crc32(c, buf.data(), (uInt)n);
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+    crc = (uint32_t)c;
+    return ok;
+}
+
+// Move a finished PNG from partPng to its name and record it in the
+// manifest; job.ddsCrc must be set (`hashed`). Writing under
+// another name first means an interrupted run never leaves a truncated PNG
+// that a later run would take for done.
+static bool commitOutput(Job& job, bool hashed)
+{
+    std::error_code ec;
+    fs::rename(job.partPng, job.png, ec);
+    if (ec) {
+        std::cout << "\nERROR: cannot rename '" << job.partPng << "': " << ec.message() << "\n";
+        fs::remove(job.partPng, ec);
+        return false;
+    }
+    job.hashed = hashed;
+
+    FileStat png;
+    statFile(job.png, png); // a failure only makes the next run redo it
+    ManifestEntry e;
+    e.ddsSize = job.ddsBytes;
+    e.ddsMtime = job.ddsMtime;
+    e.ddsCrc = job.ddsCrc;
+    e.pngSize = png.size;
+    e.pngMtime = png.mtimeNs;
+    e.settings = settingsHash;
+    e.flags = hashed ? MANIFEST_HASHED : 0;
+    manifest.record(job.key, e);
+    return true;
+}
+
+static void finishJob(size_t job, bool ok);
+
+// ------------- DEDUPLICATION -------------
+// Captures hold the same texture under many names. The scan fingerprints
+// each DDS it is about to queue (same device and inode, else same size and
+// content hash) and queues only the first of each; the others wait for its
+// PNG and get a clone of it: a reflink, else a copy, so every PNG stays a
+// file of its own; hardlinks only with --dedup hardlink. Only files
+// whose size another file already has are hashed: the first of a size is
+// hashed when the second turns up, so a tree of distinct sizes is not read
+// twice.
+enum DedupMode { DEDUP_OFF, DEDUP_AUTO, DEDUP_REFLINK, DEDUP_HARDLINK, DEDUP_COPY }; // AUTO: reflink, else copy
+DedupMode dedupMode = DEDUP_AUTO;
+
+struct DedupGroup {
+    int state = 0;              // 0 converting, 1 PNG written, -1 failed
+    std::vector<size_t> copies; // waiting for the PNG
+};
+
+std::mutex dedupMutex; // guards the maps, the groups and dedupMs
+std::unordered_map<uint64_t, size_t> firstByHash;
+std::unordered_map<uint64_t, size_t> unhashedBySize; // first of a size, not hashed yet
+std::unordered_set<uint64_t> sizesSeen;
+std::map<std::pair<uint64_t, uint64_t>, size_t> firstByInode;
+std::unordered_map<size_t, DedupGroup> dedupGroups; // by first job
+
+// Work saved, for the report
+std::atomic<int> dedupClones[3];  // by FileClone::Reflink, Hardlink, Copy
+std::atomic<uint64_t> dedupBytes(0);
+double dedupMs = 0.0;             // estimated conversion time of the clones
+
+// xxHash64 (Yann Collet), fed in pieces.
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0)
+        : seed(seed), v1(seed + P1 + P2), v2(seed + P2), v3(seed), v4(seed - P1) {}
+
+    void update(const uint8_t* p, size_t len)
+    {
+        total += len;
+        if (pending) {
+            size_t take = std::min(len, (size_t)32 - pending);
+            std::memcpy(tail + pending, p, take);
+            pending += take;
+            p += take;
+            len -= take;
+            if (pending < 32)
+                return;
+            stripe(tail);
+            pending = 0;
+        }
+        for (; len >= 32; p += 32, len -= 32)
+            stripe(p);
+        std::memcpy(tail, p, len);
+        pending = len;
+    }
+
+    uint64_t digest() const
+    {
+        uint64_t h;
+        if (total >= 32) {
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge(h, v1);
+            h = merge(h, v2);
+            h = merge(h, v3);
+            h = merge(h, v4);
+        } else {
+            h = seed + P5;
+        }
+        h += total;
+
+        const uint8_t* p = tail;
+        const uint8_t* end = tail + pending;
+        for (; p + 8 <= end; p += 8)
+            h = rotl(h ^ mix(0, read64(p)), 27) * P1 + P4;
+        if (p + 4 <= end) {
+            h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+            p += 4;
+        }
+        for (; p < end; p++)
+            h = rotl(h ^ (*p * P5), 11) * P1;
+
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static const uint64_t P1 = 11400714785074694791ULL, P2 = 14029467366897019727ULL;
+    static const uint64_t P3 = 1609587929392839161ULL, P4 = 9650029242287828579ULL;
+    static const uint64_t P5 = 2870177450012600261ULL;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    static uint64_t read64(const uint8_t* q) { uint64_t v; std::memcpy(&v, q, 8); return v; }
+    static uint64_t read32(const uint8_t* q) { uint32_t v; std::memcpy(&v, q, 4); return v; }
+    static uint64_t mix(uint64_t acc, uint64_t in) { return rotl(acc + in * P2, 31) * P1; }
+    static uint64_t merge(uint64_t acc, uint64_t v) { return (acc ^ mix(0, v)) * P1 + P4; }
+
+    void stripe(const uint8_t* p)
+    {
+        v1 = mix(v1, read64(p));
+        v2 = mix(v2, read64(p + 8));
+        v3 = mix(v3, read64(p + 16));
+        v4 = mix(v4, read64(p + 24));
+    }
+
+    uint64_t seed, v1, v2, v3, v4;
+    uint64_t total = 0;
+    uint8_t tail[32];  // input not yet in a 32-byte stripe
+    size_t pending = 0;
+};
+
+// Read through a fixed buffer, so hashing a large DDS holds no copy of it.
+#define HASH_CHUNK (256u * 1024u)
+
+static bool hashFile(const std::string& path, uint64_t& hash)
+{
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    std::vector<uint8_t> buf(HASH_CHUNK);
+    Xxh64 h;
+    size_t got;
+    while ((got = std::fread(buf.data(), 1, buf.size(), f)) > 0)
+        h.update(buf.data(), got);
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+    if (ok)
+        hash = h.digest();
+    return ok;
+}
+
+// Give copy job `index` the PNG of the job it repeats (written if `ok`).
+static void cloneOutput(size_t index, bool ok)
+{
+    Job& j = jobList[index];
+    const Job& first = jobList[j.copyOf];
+
+    bool done = false;
+    if (!ok) {
+        std::cout << "\nERROR: '" << j.dds << "' not converted: same contents as '" << first.dds << "', which failed\n";
+    } else {
+        std::error_code ec;
+        fs::remove(j.partPng, ec); // left by an interrupted run
+        FileClone how = cloneFile(first.png, j.partPng,
+                                  dedupMode == DEDUP_AUTO || dedupMode == DEDUP_REFLINK,
+                                  dedupMode == DEDUP_HARDLINK);
+        if (how == FileClone::Failed) {
+            std::cout << "\nERROR: cannot copy '" << first.png << "' to '" << j.partPng << "'\n";
+        } else {
+            j.ddsCrc = first.ddsCrc;
+            done = commitOutput(j, first.hashed);
+        }
+        if (done) {
+            dedupClones[(int)how]++;
+            dedupBytes += j.ddsBytes;
+            std::lock_guard<std::mutex> lk(dedupMutex);
+            dedupMs += j.estMs;
+        }
+    }
+    finishJob(index, done);
+}
+
+// Whether scanned job `index` repeats a DDS already queued; if so it is not
+// queued itself but waits for that job's PNG, or is cloned at once when the
+// PNG is already written.
+static bool dedupCopy(size_t index, const FileStat& st)
+{
+    Job& j = jobList[index];
+    const std::pair<uint64_t, uint64_t> inode(st.dev, st.ino);
+    const bool haveInode = st.dev || st.ino;
+
+    std::unique_lock<std::mutex> lk(dedupMutex);
+    auto byInode = haveInode ? firstByInode.find(inode) : firstByInode.end();
+    size_t first = byInode != firstByInode.end() ? byInode->second : NO_JOB;
+
+    uint64_t hash = 0;
+    bool haveHash = false;
+    bool sizeOnly = false; // first of its size: left unhashed
+    if (first == NO_JOB) {
+        if (sizesSeen.insert(j.ddsBytes).second) {
+            sizeOnly = true;
+        } else {
+            // The first of this size was left unhashed; whoever finds the
+            // second hashes it as well
+            size_t lone = NO_JOB;
+            std::string lonePath;
+            auto unhashed = unhashedBySize.find(j.ddsBytes);
+            if (unhashed != unhashedBySize.end()) {
+                lone = unhashed->second;
+                lonePath = jobList[lone].dds;
+                unhashedBySize.erase(unhashed);
             }
+            lk.unlock();
+            uint64_t loneHash = 0;
+            bool haveLone = lone != NO_JOB && hashFile(lonePath, loneHash);
+            haveHash = hashFile(j.dds, hash);
+            lk.lock();
 
-            job = jobQueue.front();
-            jobQueue.pop();
+            if (haveLone)
+                firstByHash.emplace(loneHash, lone);
+            // Another scanner may have registered the same file meanwhile
+            byInode = haveInode ? firstByInode.find(inode) : firstByInode.end();
+            if (byInode != firstByInode.end())
+                first = byInode->second;
+            auto byHash = haveHash ? firstByHash.find(hash) : firstByHash.end();
+            if (first == NO_JOB && byHash != firstByHash.end() && jobList[byHash->second].ddsBytes == j.ddsBytes)
+                first = byHash->second;
         }
+    }
+
+    if (first == NO_JOB) {
+        if (haveInode)
+            firstByInode.emplace(inode, index);
+        if (haveHash)
+            firstByHash.emplace(hash, index);
+        if (sizeOnly)
+            unhashedBySize.emplace(j.ddsBytes, index);
+        dedupGroups[index];
+        return false;
+    }
 
-        // process job
-        dds2png_convert(job.dds.c_str(), job.png.c_str());
-        jobsFinished++;
+    j.copyOf = first;
+    DedupGroup& g = dedupGroups[first];
+    if (g.state == 0) {
+        g.copies.push_back(index);
+        return true;
+    }
+    bool ok = g.state > 0;
+    lk.unlock();
+    cloneOutput(index, ok);
+    return true;
+}
 
+// Job `index` is finished: clone its PNG for the copies waiting on it.
+static void releaseCopies(size_t index, bool ok)
+{
+    std::vector<size_t> copies;
+    {
+        std::lock_guard<std::mutex> lk(dedupMutex);
+        auto it = dedupGroups.find(index);
+        if (it == dedupGroups.end())
+            return;
+        it->second.state = ok ? 1 : -1;
+        copies.swap(it->second.copies);
+    }
+    for (size_t c : copies)
+        cloneOutput(c, ok);
+}
+
+static void finishJob(size_t job, bool ok)
+{
+    const Job& j = jobList[job];
+    if (j.worker >= 0)
+        workerQueues[j.worker]->loadUs.fetch_sub((int64_t)(j.estMs * 1000.0), std::memory_order_relaxed);
+
+    if (dedupMode != DEDUP_OFF && !benchMode)
+        releaseCopies(job, ok);
+
+    if (++jobsFinished == jobsTotal.load() && !scanning.load()) {
+        // wake the parked workers so they can exit
+        { std::lock_guard<std::mutex> lk(groupMutex); }
+        groupCV.notify_all();
+    }
+
+    if (!benchMode)
         hev_progress();
+}
+
+void workerThread(int id)
+{
+    // Buffers and zlib state reused by every job this worker runs
+    dds2png_context* ctx = dds2png_context_create();
+
+    for (;;) {
+        size_t index;
+        if (!nextJob(id, index)) {
+            if (waitForWork(true))
+                continue;
+            break;
+        }
+        const Job& job = jobList[index];
+        dds2png_options opts = jobOptions(job);
+
+        // The DDS is hashed from the conversion's own mapping; a thumbnail
+        // reads one mip, so it is not hashed at all
+        const bool hash = !benchMode && !opts.max_dim;
+        uint32_t crc = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        int err = hash ? dds2png_convert_crc(ctx, job.dds.c_str(), job.partPng.c_str(), &opts, &crc)
+                       : dds2png_convert_ctx(ctx, job.dds.c_str(), benchMode ? nullptr : job.partPng.c_str(), &opts);
+        jobList[index].actualMs = msSince(t0);
+
+        bool ok = !err;
+        if (ok && !benchMode) {
+            Job& done = jobList[index];
+            done.ddsCrc = crc;
+            ok = commitOutput(done, hash);
+        }
+        finishJob(index, ok);
     }
+
+    dds2png_context_destroy(ctx);
+}
+
+// ------------- PIPELINE (--pipeline) -------------
+// read -> convert -> write as separate stages: the read stage loads whole
+// DDS files, the CPU workers convert them in memory, and the write stage
+// stores the PNGs. Reads and writes go through fileIO (file_io.h): with
+// io_uring one thread per I/O stage keeps PIPELINE_IO_DEPTH files in flight,
+// otherwise two blocking reader threads and one writer are used. Bounded
+// queues between the stages (a count and a byte budget) block a stage that
+// runs ahead, which caps the memory in flight. Each stage's threads record
+// time spent working, waiting for input (starved) and waiting for room in
+// the next queue (blocked).
+#define PIPELINE_IO_DEPTH    64
+#define PIPELINE_QUEUE_BYTES (256u << 20)
+
+struct StageStats {
+    const char* name;
+    int threads = 0;
+    std::atomic<int64_t> busyUs{0};
+    std::atomic<int64_t> starvedUs{0};
+    std::atomic<int64_t> blockedUs{0};
+
+    void add(std::atomic<int64_t>& counter, std::chrono::steady_clock::time_point t0)
+    {
+        counter += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+    }
+};
+
+StageStats stageRead, stageConvert, stageWrite;
+
+class BoundedQueue {
+public:
+    BoundedQueue(size_t maxItems, size_t maxBytes) : maxItems(maxItems), maxBytes(maxBytes) {}
+
+    // Blocks while the queue is full; a lone item may exceed the byte budget.
+    void push(FileData&& item, StageStats& st)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lk(m);
+        notFull.wait(lk, [&] {
+            return items.empty() || (items.size() < maxItems && bytes + item.size <= maxBytes);
+        });
+        bytes += item.size;
+        items.push_back(std::move(item));
+        lk.unlock();
+        notEmpty.notify_one();
+        st.add(st.blockedUs, t0);
+    }
+
+    // Blocks until an item arrives; false once the queue is closed and empty.
+    bool pop(FileData& item, StageStats& st)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lk(m);
+        notEmpty.wait(lk, [&] { return !items.empty() || closed; });
+        st.add(st.starvedUs, t0);
+        return take(item, lk);
+    }
+
+    // Never blocks; false when the queue is empty.
+    bool tryPop(FileData& item)
+    {
+        std::unique_lock<std::mutex> lk(m);
+        return take(item, lk);
+    }
+
+    void close()
+    {
+        { std::lock_guard<std::mutex> lk(m); closed = true; }
+        notEmpty.notify_all();
+    }
+
+private:
+    bool take(FileData& item, std::unique_lock<std::mutex>& lk)
+    {
+        if (items.empty())
+            return false;
+        item = std::move(items.front());
+        items.pop_front();
+        bytes -= item.size;
+        lk.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    std::mutex m;
+    std::condition_variable notEmpty, notFull;
+    std::deque<FileData> items;
+    size_t maxItems, maxBytes;
+    size_t bytes = 0;
+    bool closed = false;
+};
+
+struct Pipeline {
+    const std::vector<size_t>* order; // jobs, most expensive first
+    std::atomic<size_t> nextRead{0};
+    BoundedQueue readQ, writeQ;
+    std::atomic<int> readersLeft{0}, convertersLeft{0};
+
+    Pipeline(const std::vector<size_t>* order, int workers)
+        : order(order), readQ(2 * workers, PIPELINE_QUEUE_BYTES), writeQ(2 * workers, PIPELINE_QUEUE_BYTES) {}
+};
+
+static const std::string& outputPath(const Job& job)
+{
+    return benchWrites ? job.benchPng : job.partPng;
+}
+
+// The next job in the pipeline's order, else the biggest one the scan has
+// found; with `wait`, blocks until the scan finds one or ends.
+static bool nextReadJob(Pipeline* pl, size_t& job, bool wait)
+{
+    size_t i = pl->nextRead.fetch_add(1);
+    if (i < pl->order->size()) {
+        job = (*pl->order)[i];
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lk(groupMutex);
+    if (wait)
+        groupCV.wait(lk, [] { return !foundJobs.empty() || !scanning.load(); });
+    if (foundJobs.empty())
+        return false;
+    job = foundJobs.top().second;
+    foundJobs.pop();
+    return true;
+}
+
+static void readerThread(Pipeline* pl)
+{
+    // Busy is the thread's whole time (issuing and waiting for I/O) less the
+    // time it spent blocked on a full read queue.
+    auto t0 = std::chrono::steady_clock::now();
+    int64_t blockedUs = 0;
+
+    fileIO->readAll(
+        [pl](FileData& f, bool wait) {
+            if (!nextReadJob(pl, f.job, wait))
+                return false;
+            f.path = &jobList[f.job].dds;
+            return true;
+        },
+        [pl, &blockedUs](FileData&& f) {
+            if (f.error) {
+                std::cout << "\nERROR: cannot read '" << *f.path << "': " << std::strerror(f.error) << "\n";
+                finishJob(f.job, false);
+                return;
+            }
+            auto tp = std::chrono::steady_clock::now();
+            pl->readQ.push(std::move(f), stageRead);
+            blockedUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tp).count();
+        });
+
+    stageRead.add(stageRead.busyUs, t0);
+    stageRead.busyUs -= blockedUs;
+    if (--pl->readersLeft == 0)
+        pl->readQ.close();
+}
+
+static int appendBytes(void* user, const void* data, size_t len)
+{
+    std::vector<uint8_t>* out = (std::vector<uint8_t>*)user;
+    out->insert(out->end(), (const uint8_t*)data, (const uint8_t*)data + len);
+    return 0;
+}
+
+static void converterThread(Pipeline* pl)
+{
+    dds2png_context* ctx = dds2png_context_create();
+    const bool store = !benchMode || benchWrites;
+
+    FileData in;
+    while (pl->readQ.pop(in, stageConvert)) {
+        Job& job = jobList[in.job];
+        dds2png_options opts = jobOptions(job);
+
+        auto t0 = std::chrono::steady_clock::now();
+        FileData out;
+        out.job = in.job;
+        out.path = &outputPath(job);
+        int err = dds2png_convert_memory(ctx, in.data, in.size, job.dds.c_str(),
+                                         store ? appendBytes : nullptr, &out.heap, &opts);
+        if (!err && !benchMode)
+            job.ddsCrc = crcBytes(in.data, in.size);
+        // release the DDS before blocking on the write queue
+        fileIO->release(in.slot);
+        in = FileData();
+        out.data = out.heap.data();
+        out.size = out.heap.size();
+        job.actualMs = msSince(t0);
+        stageConvert.add(stageConvert.busyUs, t0);
+
+        if (err || !store)
+            finishJob(out.job, !err);
+        else
+            pl->writeQ.push(std::move(out), stageConvert);
+    }
+
+    dds2png_context_destroy(ctx);
+    if (--pl->convertersLeft == 0)
+        pl->writeQ.close();
+    helpUntilDone();
+}
+
+static void writerThread(Pipeline* pl)
+{
+    // Busy is the thread's whole time less the time it waited for PNGs.
+    auto t0 = std::chrono::steady_clock::now();
+    int64_t starved0 = stageWrite.starvedUs.load(); // one writer: no one else adds to it
+
+    fileIO->writeAll(
+        [pl](FileData& f, bool wait) {
+            return wait ? pl->writeQ.pop(f, stageWrite) : pl->writeQ.tryPop(f);
+        },
+        [](FileData&& f) {
+            bool ok = !f.error;
+            if (!ok) {
+                std::cout << "\nERROR: Failed writing '" << *f.path << "': " << std::strerror(f.error) << "\n";
+                std::remove(f.path->c_str());
+            } else if (!benchWrites) {
+                ok = commitOutput(jobList[f.job], true);
+            }
+            finishJob(f.job, ok);
+        });
+
+    stageWrite.add(stageWrite.busyUs, t0);
+    stageWrite.busyUs -= stageWrite.starvedUs.load() - starved0;
+}
+
+static void resetStage(StageStats& st, const char* name, int threads)
+{
+    st.name = name;
+    st.threads = threads;
+    st.busyUs = 0;
+    st.starvedUs = 0;
+    st.blockedUs = 0;
+}
+
+static void runPipeline(const std::vector<size_t>& order, int threads)
+{
+    const int readers = fileIO->readerThreads();
+    Pipeline pl(&order, threads);
+    pl.readersLeft = readers;
+    pl.convertersLeft = threads;
+    resetStage(stageRead, "read", readers);
+    resetStage(stageConvert, "convert", threads);
+    resetStage(stageWrite, "write", 1);
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < readers; i++)
+        pool.emplace_back(readerThread, &pl);
+    for (int i = 0; i < threads; i++)
+        pool.emplace_back(converterThread, &pl);
+    pool.emplace_back(writerThread, &pl);
+    for (auto& t : pool) t.join();
+}
+
+// Share of each stage's thread time spent working, starved and blocked, and
+// the stage that limits the run.
+static void stageReport(double wallMs)
+{
+    const StageStats* stages[3] = { &stageRead, &stageConvert, &stageWrite };
+
+    std::cout << ORANGE << " Stage utilization (% of wall time x threads)" << RESET << "\n"
+              << std::setw(9) << "stage" << std::setw(9) << "threads" << std::setw(9) << "busy"
+              << std::setw(10) << "starved" << std::setw(10) << "blocked" << "\n";
+
+    const StageStats* busiest = stages[0];
+    double busiestPct = -1.0;
+    for (const StageStats* st : stages) {
+        double total = wallMs * 1000.0 * st->threads;
+        double busy = total > 0.0 ? 100.0 * st->busyUs.load() / total : 0.0;
+        std::cout << std::fixed << std::setprecision(1)
+                  << std::setw(9) << st->name << std::setw(9) << st->threads
+                  << std::setw(8) << busy << "%"
+                  << std::setw(9) << (total > 0.0 ? 100.0 * st->starvedUs.load() / total : 0.0) << "%"
+                  << std::setw(9) << (total > 0.0 ? 100.0 * st->blockedUs.load() / total : 0.0) << "%\n";
+        if (busy > busiestPct) {
+            busiestPct = busy;
+            busiest = st;
+        }
+    }
+    std::cout << " Busiest stage: " << busiest->name
+              << (busiest == &stageConvert ? " (CPU-bound)" : " (I/O-bound)") << "\n";
+}
+
+// Longest-processing-time placement of the jobs in jobList: in order of
+// decreasing estimate, each goes to the worker with the least estimated work
+// so far. Returns that order and sets plannedMakespanMs.
+static std::vector<size_t> planJobs(int threads, std::vector<std::vector<size_t>>& assigned)
+{
+    std::vector<size_t> order;
+    for (size_t j = 0; j < jobList.size(); j++) {
+        if (jobList[j].copyOf == NO_JOB) // duplicates are cloned, not run
+            order.push_back(j);
+    }
+    std::stable_sort(order.begin(), order.end(), [](size_t a, size_t b) {
+        return jobList[a].estMs > jobList[b].estMs;
+    });
+
+    assigned.assign(threads, std::vector<size_t>());
+    std::vector<double> load(threads, 0.0);
+    for (size_t j : order) {
+        int w = (int)(std::min_element(load.begin(), load.end()) - load.begin());
+        assigned[w].push_back(j);
+        load[w] += jobList[j].estMs;
+    }
+    plannedMakespanMs = *std::max_element(load.begin(), load.end());
+    return order;
+}
+
+static void scanTree(fs::path root, bool feed);
+
+// Run the jobs on `threads` workers and wait for them; the joins are the
+// completion wait. Jobs already in jobList are placed by planJobs(); a
+// worker's jobs are pushed smallest first, so it pops its biggest job first
+// and thieves take its small ones. With `liveRoot`, that tree is scanned
+// meanwhile and each job found is dealt to a worker as it turns up (to the
+// read stage's foundJobs with --pipeline); the offline plan is then made
+// afterwards, as the cost report's reference.
+static void runJobs(int threads, const fs::path* liveRoot = nullptr)
+{
+    workerCount = threads;
+    jobsFinished = 0;
+
+    std::vector<std::vector<size_t>> assigned(threads);
+    std::vector<size_t> order;
+    if (!liveRoot)
+        order = planJobs(threads, assigned);
+
+    workerQueues.clear();
+    jobsWaiting = 0;
+    for (int i = 0; i < threads; i++) {
+        workerQueues.emplace_back(new WorkerQueue());
+        WorkerQueue& q = *workerQueues.back();
+        q.deque.reset(new JobDeque(liveRoot ? LIVE_DEQUE_JOBS : assigned[i].size() + 1));
+        for (auto it = assigned[i].rbegin(); it != assigned[i].rend(); ++it)
+            q.deque->push(*it);
+        jobsWaiting += (int)assigned[i].size();
+    }
+
+    std::thread scanner;
+    if (liveRoot)
+        scanner = std::thread(scanTree, *liveRoot, true);
+
+    if (pipelineMode) {
+        runPipeline(order, threads);
+    } else {
+        std::vector<std::thread> pool;
+        for (int i = 0; i < threads; i++)
+            pool.emplace_back(workerThread, i);
+        for (auto& t : pool) t.join();
+    }
+
+    if (liveRoot) {
+        scanner.join();
+        planJobs(threads, assigned);
+    }
+}
+
+static const char* formatName(uint32_t dxgi)
+{
+    switch (dxgi) {
+    case 71: return "BC1";
+    case 74: return "BC2";
+    case 77: return "BC3";
+    case 80: return "BC4";
+    case 83: return "BC5";
+    case 98: return "BC7";
+    default: return "other";
+    }
+}
+
+// Estimated vs. measured cost of the last run, per format, and the planned
+// vs. actual makespan.
+static void costReport(double wallMs)
+{
+    struct Totals { int files = 0; double est = 0.0, actual = 0.0; };
+    std::map<uint32_t, Totals> byFormat;
+    for (size_t i = 0; i < jobList.size(); i++) {
+        const Job& j = jobList[i];
+        if (j.copyOf != NO_JOB)
+            continue; // see dedupReport()
+        Totals& t = byFormat[j.dxgi];
+        t.files++;
+        t.est += j.estMs;
+        t.actual += j.actualMs;
+    }
+
+    std::cout << ORANGE << " Cost by format (ms, summed over jobs)" << RESET << "\n"
+              << std::setw(8) << "format" << std::setw(8) << "files" << std::setw(12) << "estimated"
+              << std::setw(12) << "actual" << std::setw(10) << "act/est" << "\n";
+    for (auto& f : byFormat) {
+        const Totals& t = f.second;
+        std::cout << std::fixed << std::setprecision(1)
+                  << std::setw(8) << formatName(f.first) << std::setw(8) << t.files
+                  << std::setw(12) << t.est << std::setw(12) << t.actual
+                  << std::setw(9) << std::setprecision(2) << (t.est > 0.0 ? t.actual / t.est : 0.0) << "x\n";
+    }
+    std::cout << std::fixed << std::setprecision(1)
+              << " Makespan on " << workerCount << " worker(s): planned " << plannedMakespanMs
+              << " ms, actual " << wallMs << " ms\n";
+}
+
+// Duplicates of the last run and the work they saved.
+static void dedupReport()
+{
+    int reflinks = dedupClones[(int)FileClone::Reflink].load();
+    int hardlinks = dedupClones[(int)FileClone::Hardlink].load();
+    int copies = dedupClones[(int)FileClone::Copy].load();
+    if (reflinks + hardlinks + copies == 0)
+        return;
+
+    std::cout << ORANGE << " Duplicates" << RESET << "\n"
+              << " " << reflinks + hardlinks + copies << " PNG(s) cloned from identical DDS files ("
+              << reflinks << " reflink, " << hardlinks << " hardlink, " << copies << " copy)\n"
+              << std::fixed << std::setprecision(1)
+              << " Saved: " << dedupBytes.load() / 1048576.0 << " MiB of DDS not decoded, ~"
+              << dedupMs << " ms of decode and compress (single-core estimate)\n";
+}
+
+// Uniform and repeated blocks the decoders skipped, per format (--stats).
+static void blockReport()
+{
+    static const uint32_t formats[] = { 71, 74, 77, 80, 83, 98 };
+    std::cout << ORANGE << " Decode fast paths" << RESET << "\n"
+              << std::setw(8) << "format" << std::setw(14) << "blocks" << std::setw(14) << "uniform"
+              << std::setw(14) << "repeated" << "\n";
+    for (uint32_t dxgi : formats) {
+        dds2png_block_stats st;
+        dds2png_get_block_stats(dxgi, &st);
+        if (!st.blocks)
+            continue;
+        std::cout << std::fixed << std::setprecision(1)
+                  << std::setw(8) << formatName(dxgi) << std::setw(14) << st.blocks
+                  << std::setw(13) << 100.0 * st.uniform / st.blocks << "%"
+                  << std::setw(13) << 100.0 * st.repeated / st.blocks << "%\n";
+    }
+}
+
+// --bench --pipeline: files per second of each I/O backend on the same
+// tree at `threads` workers, this time writing the PNGs (to <name>.png.bench,
+// removed after each run) so both reads and writes are measured.
+static void ioBench(int threads)
+{
+    std::vector<std::unique_ptr<FileIO>> backends;
+    if (auto uring = makeUringFileIO(PIPELINE_IO_DEPTH))
+        backends.push_back(std::move(uring));
+    backends.push_back(makeBlockingFileIO());
+
+    for (size_t i = 0; i < jobList.size(); i++)
+        jobList[i].benchPng = jobList[i].png + ".bench";
+    std::unique_ptr<FileIO> selected = std::move(fileIO);
+    benchWrites = true;
+
+    std::cout << "\n" << ORANGE << " I/O backends (" << threads << " worker(s), PNGs written)" << RESET << "\n"
+              << std::setw(10) << "backend" << std::setw(12) << "files/s" << std::setw(10) << "ms" << "\n";
+    for (auto& io : backends) {
+        fileIO = std::move(io);
+        runJobs(threads); // first pass creates the outputs
+        auto t0 = std::chrono::steady_clock::now();
+        runJobs(threads);
+        double ms = msSince(t0);
+        std::cout << std::fixed << std::setprecision(1)
+                  << std::setw(10) << fileIO->name() << std::setw(12) << jobsTotal.load() * 1000.0 / ms
+                  << std::setw(10) << ms << "\n";
+        for (size_t i = 0; i < jobList.size(); i++)
+            std::remove(jobList[i].benchPng.c_str());
+    }
+
+    benchWrites = false;
+    fileIO = std::move(selected);
+}
+
+// --bench: convert the whole tree (without writing PNGs) at 1, 2, 4, ...
+// threads up to the requested count and report jobs per second.
+static void runBench(int maxThreads)
+{
+    std::vector<int> counts;
+    for (int t = 1; t < maxThreads; t *= 2)
+        counts.push_back(t);
+    counts.push_back(maxThreads);
+
+    runJobs(maxThreads); // warm the page cache
+
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "jobs/s"
+              << std::setw(10) << "speedup" << std::setw(10) << "ms" << "\n";
+
+    double base = 0.0, lastMs = 0.0;
+    for (int t : counts) {
+        auto t0 = std::chrono::steady_clock::now();
+        runJobs(t);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+        double rate = jobsTotal.load() * 1000.0 / ms;
+        if (t == 1) base = rate;
+        std::cout << std::fixed << std::setprecision(1)
+                  << std::setw(8) << t << std::setw(12) << rate
+                  << std::setw(9) << rate / base << "x" << std::setw(10) << ms << "\n";
+        lastMs = ms;
+    }
+
+    std::cout << "\n";
+    costReport(lastMs);
+    if (pipelineMode) {
+        stageReport(lastMs);
+        ioBench(maxThreads);
+    }
+}
+
+// ------------- DIRECTORY SCAN -------------
+// SCAN_THREADS threads list the tree one directory at a time: subdirectories
+// go back on a shared list for any scanner to take, and each listing also
+// tells which DDS files have a PNG beside them. Those DDS are stat'ed (a
+// directory entry has no size or mtime to go by) and their PNG's tail read
+// to check both against the manifest. Jobs are added to jobList (and
+// jobsTotal, which the progress bar shows) as they are found; with `feed`
+// they also go straight to the workers (dealJob), or to foundJobs for the
+// pipeline's read stage.
+#define SCAN_THREADS 8
+
+// A PNG ends with its IEND chunk; one cut short by a crash does not. Also
+// stats it, for comparing with the manifest.
+static bool pngComplete(const std::string& path, FileStat& st)
+{
+    static const uint8_t iend[12] = { 0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82 };
+    uint8_t tail[12];
+    return statFileTail(path, st, tail, 12) && std::memcmp(tail, iend, 12) == 0;
+}
+
+// The PNG `e` recorded is still there: complete, same size and mtime.
+static bool pngIntact(const Job& j, const ManifestEntry& e)
+{
+    FileStat png;
+    return pngComplete(j.png, png) && png.size == e.pngSize && png.mtimeNs == e.pngMtime;
+}
+
+// Whether the PNG beside `j` (scanned: key, ddsBytes, ddsMtime) is current,
+// in which case its manifest entry is carried over. A DDS whose mtime moved
+// but whose size did not is compared by content; the PNG must be complete
+// and have the size and mtime it was recorded with. On a root without a
+// manifest, complete PNGs already there are taken as current unless their
+// DDS is newer.
+static bool upToDate(const Job& j)
+{
+    const ManifestEntry* e = manifest.find(j.key);
+    if (!e) {
+        FileStat png;
+        if (!manifestFresh || !pngComplete(j.png, png) || png.mtimeNs < j.ddsMtime)
+            return false;
+        ManifestEntry adopted;
+        adopted.ddsSize = j.ddsBytes;
+        adopted.ddsMtime = j.ddsMtime;
+        adopted.pngSize = png.size;
+        adopted.pngMtime = png.mtimeNs;
+        adopted.settings = settingsHash;
+        manifest.record(j.key, adopted);
+        return true;
+    }
+
+    if (e->settings != settingsHash || e->ddsSize != j.ddsBytes || !pngIntact(j, *e))
+        return false;
+    if (e->ddsMtime == j.ddsMtime) {
+        manifest.keep(j.key, *e);
+        return true;
+    }
+
+    uint32_t crc;
+    if (!(e->flags & MANIFEST_HASHED) || !crcFile(j.dds, crc) || crc != e->ddsCrc)
+        return false;
+    ManifestEntry touched = *e;
+    touched.ddsMtime = j.ddsMtime;
+    manifest.record(j.key, touched);
+    return true;
+}
+
+struct DirScan {
+    fs::path root;
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<fs::path> dirs; // waiting to be listed
+    int listing = 0;            // scanners inside a directory
+    bool feed = false;
+};
+
+static void scanDir(DirScan* sc, const fs::path& dir)
+{
+    std::vector<fs::path> subdirs, dds;
+    std::unordered_set<std::string> names;
+
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        const fs::directory_entry& entry = *it;
+        const fs::path& p = entry.path();
+        names.insert(p.filename().string());
+
+        // Types come from the listing; symlinked directories are not followed
+        std::error_code typeEc;
+        if (!entry.is_symlink(typeEc) && entry.is_directory(typeEc))
+            subdirs.push_back(p);
+        else if ((p.extension() == ".dds" || p.extension() == ".DDS") && entry.is_regular_file(typeEc))
+            dds.push_back(p);
+    }
+    if (ec)
+        std::cout << "\nERROR: cannot list '" << dir.string() << "': " << ec.message() << "\n";
+
+    if (!subdirs.empty()) {
+        {
+            std::lock_guard<std::mutex> lk(sc->m);
+            sc->dirs.insert(sc->dirs.end(), subdirs.begin(), subdirs.end());
+        }
+        sc->cv.notify_all();
+    }
+
+    for (const fs::path& p : dds) {
+        // Thumbnails go beside the full-size PNG, not over it
+        fs::path out = p;
+        out.replace_extension(convertOptions.max_dim ? ".thumb.png" : ".png");
+
+        Job j;
+        j.dds = p.string();
+        j.png = out.string();
+        FileStat st;
+        if (!benchMode) {
+            j.partPng = j.png + ".part";
+            j.key = p.lexically_relative(sc->root).generic_string();
+            if (statFile(j.dds, st)) {
+                j.ddsBytes = st.size;
+                j.ddsMtime = st.mtimeNs;
+            }
+            if (names.count(out.filename().string()) && upToDate(j))
+                continue;
+        }
+
+        // Header only: size and format give the cost estimate
+        dds2png_probe_info info;
+        if (dds2png_probe(j.dds.c_str(), &convertOptions, &info) == 0) {
+            j.dxgi = info.dxgi;
+            j.estMs = info.est_ms;
+            if (!j.ddsBytes)
+                j.ddsBytes = info.file_size;
+        }
+        double estMs = j.estMs;
+        size_t index = jobList.push(std::move(j));
+        jobsTotal++;
+
+        if (sc->feed) {
+            if (dedupMode != DEDUP_OFF && dedupCopy(index, st)) {
+                hev_progress();
+                continue;
+            }
+            if (pipelineMode) {
+                {
+                    std::lock_guard<std::mutex> lk(groupMutex);
+                    foundJobs.emplace(estMs, index);
+                }
+                groupCV.notify_all();
+            } else {
+                dealJob(index);
+            }
+            if (!benchMode)
+                hev_progress();
+        }
+    }
+}
+
+static void scannerThread(DirScan* sc)
+{
+    std::unique_lock<std::mutex> lk(sc->m);
+    for (;;) {
+        // Done once nothing is waiting and no one is listing (and so could
+        // add more).
+        sc->cv.wait(lk, [sc] { return !sc->dirs.empty() || sc->listing == 0; });
+        if (sc->dirs.empty())
+            return;
+
+        fs::path dir = std::move(sc->dirs.back());
+        sc->dirs.pop_back();
+        sc->listing++;
+        lk.unlock();
+        scanDir(sc, dir);
+        lk.lock();
+        if (--sc->listing == 0 && sc->dirs.empty())
+            sc->cv.notify_all();
+    }
+}
+
+// Scan the tree under `root`; returns when all of it is listed. The caller
+// sets `scanning` first, so workers started meanwhile keep waiting for jobs.
+static void scanTree(fs::path root, bool feed)
+{
+    DirScan sc;
+    sc.root = root;
+    sc.feed = feed;
+    sc.dirs.push_back(root);
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < SCAN_THREADS; i++)
+        pool.emplace_back(scannerThread, &sc);
+    for (auto& t : pool) t.join();
+
+    {
+        std::lock_guard<std::mutex> lk(groupMutex);
+        scanning = false;
+    }
+    groupCV.notify_all();
 }
 
 // ------------- MAIN -------------
@@ -135,7 +1586,10 @@ int main(int argc, char** argv)
 {
     if (argc < 2) {
         std::cout << "Usage: " << argv[0] << ORANGE
-        << " <directory> [threads]\n" << RESET;
+        << " <directory> [threads] [--preset fast|balanced|archive] [--level N]\n"
+        << "       [--strategy NAME] [--mem-level N] [--window-bits N] [--filter NAME]\n"
+        << "       [--time-budget MS] [--max-dim N] [--pipeline] [--io uring|blocking]\n"
+        << "       [--dedup auto|reflink|hardlink|copy|off] [--stats] [--bench]\n" << RESET;
         return 1;
     }
 
@@ -145,71 +1599,122 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    // Optional override thread count
-    int threads = (argc >= 3) ? std::stoi(argv[2])
-    : (int)std::thread::hardware_concurrency();
-    if (threads < 1) threads = 1;
+    // Optional thread count and compression flags
+    int threads = (int)std::thread::hardware_concurrency();
+    dds2png_options_init(&convertOptions);
+    std::string ioName = "uring";
 
-    // HEV boot-up
-    hev_startup();
+    for (int i = 2; i < argc; ) {
+        if (std::string(argv[i]) == "--bench") {
+            benchMode = true;
+            i++;
+        } else if (std::string(argv[i]) == "--stats") {
+            statsMode = true;
+            i++;
+        } else if (std::string(argv[i]) == "--pipeline") {
+            pipelineMode = true;
+            i++;
+        } else if (std::string(argv[i]) == "--dedup") {
+            static const char* modes[] = { "off", "auto", "reflink", "hardlink", "copy" };
+            std::string mode = i + 1 < argc ? argv[i + 1] : "";
+            int m = 0;
+            while (m < 5 && mode != modes[m]) m++;
+            if (m == 5) {
+                std::cout << "ERROR: --dedup takes auto, reflink, hardlink, copy or off\n";
+                return 1;
+            }
+            dedupMode = (DedupMode)m;
+            i += 2;
+        } else if (std::string(argv[i]) == "--io") {
+            ioName = i + 1 < argc ? argv[i + 1] : "";
+            if (ioName != "uring" && ioName != "blocking") {
+                std::cout << "ERROR: --io takes uring or blocking\n";
+                return 1;
+            }
+            pipelineMode = true;
+            i += 2;
+        } else if (std::string(argv[i]).rfind("--", 0) == 0) {
+            int used = dds2png_parse_option(&convertOptions, argv[i], i + 1 < argc ? argv[i + 1] : nullptr);
+            if (used == 0)
+                std::cout << "ERROR: unknown option '" << argv[i] << "'\n";
+            if (used <= 0)
+                return 1;
+            i += used;
+        } else {
+            threads = std::stoi(argv[i]);
+            i++;
+        }
+    }
+    if (threads < 1) threads = 1;
 
-    std::cout << ORANGE << BOLD << " Spawning conversion threads: " << threads
-    << RESET << "\n";
+    // The pipeline reads whole files; a thumbnail run only needs the pages
+    // of one mip, which the direct path's mapping reads on its own.
+    if (pipelineMode && convertOptions.max_dim) {
+        std::cout << YELLOW << "--max-dim reads only one mip per file, converting without the pipeline\n" << RESET;
+        pipelineMode = false;
+    }
 
-    // Scan filesystem
-    std::vector<Job> jobs;
+    if (pipelineMode) {
+        if (ioName == "uring") {
+            fileIO = makeUringFileIO(PIPELINE_IO_DEPTH);
+            if (!fileIO)
+                std::cout << YELLOW << "io_uring unavailable, using blocking I/O\n" << RESET;
+        }
+        if (!fileIO)
+            fileIO = makeBlockingFileIO();
+    }
 
-    for (auto& entry : fs::recursive_directory_iterator(root)) {
-        if (!entry.is_regular_file()) continue;
+    // HEV boot-up
+    if (!benchMode) {
+        hev_startup();
 
-        fs::path p = entry.path();
-        if (p.extension() == ".dds" || p.extension() == ".DDS") {
-            fs::path out = p;
-            out.replace_extension(".png");
+        std::cout << ORANGE << BOLD << " Spawning conversion threads: " << threads
+        << RESET << "\n";
+    }
 
-            if (fs::exists(out)) continue;
+    if (!benchMode) {
+        settingsHash = manifestSettings(convertOptions);
+        manifestFresh = !manifest.load(root, convertOptions.max_dim ? MANIFEST_THUMBS : MANIFEST_FULL);
+    }
 
-            Job j;
-            j.dds = p.string();
-            j.png = out.string();
-            jobs.push_back(j);
-        }
+    // Scan the tree. A bench needs the whole list first; a normal run
+    // converts while the scan is still going.
+    scanning = true;
+    double wallMs = 0.0;
+    if (benchMode) {
+        scanTree(root, false);
+    } else {
+        auto t0 = std::chrono::steady_clock::now();
+        runJobs(threads, &root);
+        wallMs = msSince(t0);
     }
 
-    jobsTotal = (int)jobs.size();
+    if (!benchMode && !manifest.save())
+        std::cout << "\nWARNING: cannot write the manifest in '" << root.string() << "'\n";
 
     if (jobsTotal == 0) {
         std::cout << YELLOW << "No DDS files found.\n" << RESET;
         return 0;
     }
 
-    std::cout << ORANGE << " Total DDS files: " << jobsTotal << RESET << "\n\n";
-
-    // Fill queue
-    {
-        std::lock_guard<std::mutex> lk(queueMutex);
-        for (auto& j : jobs)
-            jobQueue.push(j);
-    }
-
-    // Launch threads
-    std::vector<std::thread> pool;
-    for (int i = 0; i < threads; i++)
-        pool.emplace_back(workerThread, i);
-
-    queueCV.notify_all();
-
-    // Main wait loop
-    while (jobsFinished.load() < jobsTotal.load()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (benchMode) {
+        std::cout << ORANGE << " Total DDS files: " << jobsTotal << RESET << "\n\n";
+        runBench(threads);
+        if (statsMode)
+            blockReport();
+        return 0;
     }
 
-    done = true;
-    queueCV.notify_all();
+    std::cout << "\n\n";
+    std::cout << ORANGE << " Total DDS files: " << jobsTotal << RESET << "\n";
+    costReport(wallMs);
+    dedupReport();
+    if (statsMode)
+        blockReport();
+    if (pipelineMode)
+        stageReport(wallMs);
 
-    for (auto& t : pool) t.join();
-
-    std::cout << "\n\n" << BOLD << ORANGE
+    std::cout << "\n" << BOLD << ORANGE
     << "✔ ALL CONVERSIONS COMPLETE\n"
     << "Thank you for using the H.E.V image conversion subsystem."
     << RESET << "\n";
@@ -1,4 +1,7 @@
 #include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
 #include "bc7_decoder.h"
 #include "bc7decomp.h"   // from the bc7decomp/bc7enc_rdo repo
 
@@ -25,3 +28,188 @@ extern "C" void bc7_decode_block(const uint8_t block[16], uint8_t out_rgba[16 *
         out_rgba[i*4+3] = pixels[i].a;
     }
 }
+
+extern "C" void bc7_decode_blocks(const uint8_t* blocks, size_t count, uint8_t* dst, size_t dst_pitch)
+{
+    // Same magenta fallback as bc7_decode_block()
+    bc7decomp::unpack_bc7_blocks(blocks, count, dst, dst_pitch, bc7decomp::color_rgba(255, 0, 255, 255));
+}
+
+extern "C" int bc7_block_uniform(const uint8_t block[16], uint8_t rgba[4])
+{
+    // Equal endpoints interpolate to themselves at every weight, so the
+    // indices do not matter
+    const bool mode6 = (block[0] & 0x7F) == 0x40;
+    const bool mode5 = (block[0] & 0x3F) == 0x20;
+    if (!mode6 && !mode5)
+        return 0;
+
+    uint64_t lo = 0, hi = 0;
+    for (int i = 0; i < 8; ++i) {
+        lo |= (uint64_t)block[i] << (8 * i);
+        hi |= (uint64_t)block[8 + i] << (8 * i);
+    }
+
+    if (mode6) {
+        // 7-bit R0 @7, R1 @14, G0 @21 ... A1 @56, then P0 @63 and P1 @64
+        const uint32_t p = (uint32_t)(lo >> 63);
+        if (p != (uint32_t)(hi & 1))
+            return 0;
+        for (int c = 0; c < 4; ++c) {
+            const uint32_t e0 = (uint32_t)(lo >> (7 + 14 * c)) & 0x7F;
+            const uint32_t e1 = (uint32_t)(lo >> (14 + 14 * c)) & 0x7F;
+            if (e0 != e1)
+                return 0;
+            rgba[c] = (uint8_t)(e0 << 1 | p);
+        }
+        return 1;
+    }
+
+    // Mode 5: rotation @6, 7-bit R0 @8, R1 @15 ... B1 @43, 8-bit A0 @50, A1 @58
+    for (int c = 0; c < 3; ++c) {
+        const uint32_t e0 = (uint32_t)(lo >> (8 + 14 * c)) & 0x7F;
+        const uint32_t e1 = (uint32_t)(lo >> (15 + 14 * c)) & 0x7F;
+        if (e0 != e1)
+            return 0;
+        rgba[c] = (uint8_t)(e0 << 1 | e0 >> 6);
+    }
+    const uint32_t a0 = (uint32_t)(lo >> 50) & 0xFF;
+    const uint32_t a1 = (uint32_t)((lo >> 58) | (hi << 6)) & 0xFF;
+    if (a0 != a1)
+        return 0;
+    rgba[3] = (uint8_t)a0;
+
+    const uint32_t rotation = (uint32_t)(lo >> 6) & 3;
+    if (rotation) {
+        const uint8_t t = rgba[3];
+        rgba[3] = rgba[rotation - 1];
+        rgba[rotation - 1] = t;
+    }
+    return 1;
+}
+
+// Sum over 16 pixels of the interpolation between e0 and e1 (BC7's 6-bit
+// weights) each pixel's index selects; count[i] pixels use index i.
+static uint32_t bc7_weighted_sum(uint32_t e0, uint32_t e1, const uint32_t* weights,
+                                 const uint32_t* count, int entries)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < entries; ++i)
+        sum += count[i] * ((e0 * (64 - weights[i]) + e1 * weights[i] + 32) >> 6);
+    return sum;
+}
+
+extern "C" void bc7_block_mean(const uint8_t block[16], uint8_t rgba[4])
+{
+    static const uint32_t weights2[4] = { 0, 21, 43, 64 };
+    static const uint32_t weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    uint64_t lo = 0, hi = 0;
+    for (int i = 0; i < 8; ++i) {
+        lo |= (uint64_t)block[i] << (8 * i);
+        hi |= (uint64_t)block[8 + i] << (8 * i);
+    }
+
+    if ((block[0] & 0x7F) == 0x40) {
+        // Mode 6: 4-bit indices from bit 65, 3 bits for the anchor pixel 0
+        uint64_t idx = hi >> 1;
+        idx = ((idx & ~7ull) << 1) | (idx & 7);
+        uint32_t count[16] = { 0 };
+        for (int i = 0; i < 16; ++i)
+            count[(idx >> (4 * i)) & 15]++;
+
+        const uint32_t p0 = (uint32_t)(lo >> 63), p1 = (uint32_t)(hi & 1);
+        for (int c = 0; c < 4; ++c) {
+            const uint32_t e0 = ((uint32_t)(lo >> (7 + 14 * c)) & 0x7F) << 1 | p0;
+            const uint32_t e1 = ((uint32_t)(lo >> (14 + 14 * c)) & 0x7F) << 1 | p1;
+            rgba[c] = (uint8_t)((bc7_weighted_sum(e0, e1, weights4, count, 16) + 8) >> 4);
+        }
+        return;
+    }
+
+    if ((block[0] & 0x3F) == 0x20) {
+        // Mode 5: 2-bit color indices from bit 66 and alpha indices from bit
+        // 97, 1 bit each for the anchor pixel 0
+        uint64_t cidx = (hi >> 2) & 0x7FFFFFFF, aidx = hi >> 33;
+        cidx = ((cidx & ~1ull) << 1) | (cidx & 1);
+        aidx = ((aidx & ~1ull) << 1) | (aidx & 1);
+        uint32_t ccount[4] = { 0 }, acount[4] = { 0 };
+        for (int i = 0; i < 16; ++i) {
+            ccount[(cidx >> (2 * i)) & 3]++;
+            acount[(aidx >> (2 * i)) & 3]++;
+        }
+
+        for (int c = 0; c < 3; ++c) {
+            uint32_t e0 = (uint32_t)(lo >> (8 + 14 * c)) & 0x7F;
+            uint32_t e1 = (uint32_t)(lo >> (15 + 14 * c)) & 0x7F;
+            e0 = e0 << 1 | e0 >> 6;
+            e1 = e1 << 1 | e1 >> 6;
+            rgba[c] = (uint8_t)((bc7_weighted_sum(e0, e1, weights2, ccount, 4) + 8) >> 4);
+        }
+        const uint32_t a0 = (uint32_t)(lo >> 50) & 0xFF;
+        const uint32_t a1 = (uint32_t)((lo >> 58) | (hi << 6)) & 0xFF;
+        rgba[3] = (uint8_t)((bc7_weighted_sum(a0, a1, weights2, acount, 4) + 8) >> 4);
+
+        // Rotation swaps alpha with R, G or B in every pixel, so in the mean
+        const uint32_t rotation = (uint32_t)(lo >> 6) & 3;
+        if (rotation) {
+            const uint8_t t = rgba[3];
+            rgba[3] = rgba[rotation - 1];
+            rgba[rotation - 1] = t;
+        }
+        return;
+    }
+
+    uint8_t pixels[16 * 4];
+    bc7_decode_block(block, pixels);
+    for (int c = 0; c < 4; ++c) {
+        uint32_t sum = 8;
+        for (int i = 0; i < 16; ++i)
+            sum += pixels[i * 4 + c];
+        rgba[c] = (uint8_t)(sum >> 4);
+    }
+}
+
+extern "C" void bc7_time_modes(const uint8_t* blocks, size_t count, bc7_mode_timing timing[8])
+{
+    typedef std::chrono::steady_clock clock;
+    const size_t strip = 256; // blocks per decode call, like one block row
+
+    std::vector<uint8_t> mode_blocks;
+    std::vector<uint8_t> image(strip * 16 * 4);
+    const size_t pitch = strip * 16;
+
+    for (int mode = 0; mode < 8; ++mode) {
+        // Gather this mode's blocks (the mode is the lowest set bit of byte 0)
+        mode_blocks.clear();
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* blk = blocks + i * 16;
+            if (blk[0] != 0 && (blk[0] & -blk[0]) == (1 << mode))
+                mode_blocks.insert(mode_blocks.end(), blk, blk + 16);
+        }
+        const size_t n = mode_blocks.size() / 16;
+        if (n == 0)
+            continue;
+
+        clock::time_point t0 = clock::now();
+        for (size_t base = 0; base < n; base += strip) {
+            const size_t m = (n - base < strip) ? n - base : strip;
+            for (size_t i = 0; i < m; ++i) {
+                uint8_t rgba[16 * 4];
+                bc7_decode_block(&mode_blocks[(base + i) * 16], rgba);
+                for (int y = 0; y < 4; ++y)
+                    memcpy(&image[y * pitch + i * 16], rgba + y * 16, 16);
+            }
+        }
+        clock::time_point t1 = clock::now();
+        for (size_t base = 0; base < n; base += strip) {
+            const size_t m = (n - base < strip) ? n - base : strip;
+            bc7_decode_blocks(&mode_blocks[base * 16], m, image.data(), pitch);
+        }
+        clock::time_point t2 = clock::now();
+
+        timing[mode].blocks    += n;
+        timing[mode].single_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        timing[mode].batch_ms  += std::chrono::duration<double, std::milli>(t2 - t1).count();
+    }
+}
@@ -1,6 +1,7 @@
 #ifndef BC7_DECODER_H
 #define BC7_DECODER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -10,6 +11,31 @@ extern "C" {
 // Decode one BC7 16-byte block into 16 RGBA8 pixels.
 void bc7_decode_block(const uint8_t block[16], uint8_t out_rgba[16 * 4]);
 
+// Decode `count` consecutive BC7 blocks, one block row strip, straight into
+// an RGBA8 image: block i lands at dst + i * 16 with `dst_pitch` bytes
+// between pixel rows.
+void bc7_decode_blocks(const uint8_t* blocks, size_t count, uint8_t* dst, size_t dst_pitch);
+
+// If all 16 pixels of `block` decode to one color, store it at rgba and
+// return 1; else return 0. Only recognizes mode 5 and 6 blocks whose two
+// endpoints are equal (the usual encoding of a solid block).
+int bc7_block_uniform(const uint8_t block[16], uint8_t rgba[4]);
+
+// Rounded mean of the 16 pixels of `block`, as RGBA at rgba. Mode 5 and 6
+// blocks (single subset) are averaged from their endpoints and a histogram
+// of the indices; other modes are decoded and summed.
+void bc7_block_mean(const uint8_t block[16], uint8_t rgba[4]);
+
+// Per-mode decode timing (dds2png --bench).
+typedef struct {
+    uint64_t blocks;
+    double single_ms; // bc7_decode_block() per block, copied into the image
+    double batch_ms;  // bc7_decode_blocks()
+} bc7_mode_timing;
+
+// Decode `count` blocks both ways, one mode at a time, adding to timing[0..7].
+void bc7_time_modes(const uint8_t* blocks, size_t count, bc7_mode_timing timing[8]);
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,6 +6,10 @@
 #  define BC7DECOMP_USE_SSE2
 #endif
 
+#if defined(BC7DECOMP_USE_SSE2) && defined(__AVX2__)
+#  define BC7DECOMP_USE_AVX2
+#endif
+
 #ifdef BC7DECOMP_USE_SSE2
 #include <immintrin.h>
 #include <emmintrin.h>
@@ -175,7 +179,6 @@ bool unpack_bc7_mode0_2(uint32_t mode, const uint64_t* data_chunks, color_rgba*
 	const uint32_t ENDPOINT_BITS = (mode == 0) ? 4 : 5;
 	const uint32_t ENDPOINT_MASK = (1 << ENDPOINT_BITS) - 1;
 	const uint32_t PBITS = (mode == 0) ? 6 : 0;
-	const uint32_t WEIGHT_VALS = 1 << WEIGHT_BITS;
 	const uint32_t PART_BITS = (mode == 0) ? 4 : 6;
 	const uint32_t PART_MASK = (1 << PART_BITS) - 1;
 
@@ -246,6 +249,7 @@ bool unpack_bc7_mode0_2(uint32_t mode, const uint64_t* data_chunks, color_rgba*
 			bc7_interp3_sse2(endpoints + s * 2, block_colors[s]);
 	}
 #else
+	const uint32_t WEIGHT_VALS = 1 << WEIGHT_BITS;
 	for (uint32_t s = 0; s < 3; s++)
 		for (uint32_t i = 0; i < WEIGHT_VALS; i++)
 		{
@@ -272,7 +276,6 @@ bool unpack_bc7_mode1_3_7(uint32_t mode, const uint64_t* data_chunks, color_rgba
 	const uint32_t ENDPOINT_MASK = (1 << ENDPOINT_BITS) - 1;
 	const uint32_t PBITS = (mode == 1) ? 2 : 4;
 	const uint32_t SHARED_PBITS = (mode == 1) ? true : false;
-	const uint32_t WEIGHT_VALS = 1 << WEIGHT_BITS;
 
 	const uint64_t low_chunk = data_chunks[0];
 	const uint64_t high_chunk = data_chunks[1];
@@ -349,6 +352,7 @@ bool unpack_bc7_mode1_3_7(uint32_t mode, const uint64_t* data_chunks, color_rgba
 			bc7_interp3_sse2(endpoints + s * 2, block_colors[s]);
 	}
 #else
+	const uint32_t WEIGHT_VALS = 1 << WEIGHT_BITS;
 	for (uint32_t s = 0; s < 2; s++)
 		for (uint32_t i = 0; i < WEIGHT_VALS; i++)
 		{
@@ -591,18 +595,14 @@ bool unpack_bc7_mode6(const void *pBlock_bits, color_rgba *pPixels)
 	return true;
 }
 
-bool unpack_bc7(const void *pBlock, color_rgba *pPixels)
+static inline void load_bc7_chunks(const void *pBlock, uint64_t *data_chunks)
 {
-	const uint8_t *block_bytes = static_cast<const uint8_t*>(pBlock);
-	uint8_t mode = g_bc7_first_byte_to_mode[block_bytes[0]];
-
-	uint64_t data_chunks[2];
-
 	uint64_t endian_check = 1;
 	if (*reinterpret_cast<const uint8_t*>(&endian_check) == 1)
 		memcpy(data_chunks, pBlock, 16);
 	else
 	{
+		const uint8_t *block_bytes = static_cast<const uint8_t*>(pBlock);
 		data_chunks[0] = data_chunks[1] = 0;
 		for (int chunk_index = 0; chunk_index < 2; chunk_index++)
 		{
@@ -610,6 +610,15 @@ bool unpack_bc7(const void *pBlock, color_rgba *pPixels)
 				data_chunks[chunk_index] |= static_cast<uint64_t>(block_bytes[chunk_index * 8 + byte_index]) << (byte_index * 8);
 		}
 	}
+}
+
+bool unpack_bc7(const void *pBlock, color_rgba *pPixels)
+{
+	const uint8_t *block_bytes = static_cast<const uint8_t*>(pBlock);
+	uint8_t mode = g_bc7_first_byte_to_mode[block_bytes[0]];
+
+	uint64_t data_chunks[2];
+	load_bc7_chunks(pBlock, data_chunks);
 
 	switch (mode)
 	{
@@ -626,13 +635,237 @@ bool unpack_bc7(const void *pBlock, color_rgba *pPixels)
 	case 6:
 		return unpack_bc7_mode6(data_chunks, pPixels);
 	default:
-		memset(pPixels, 0, sizeof(color_rgba) * 16);
+		memset((void*)pPixels, 0, sizeof(color_rgba) * 16);
 		break;
 	}
 
 	return false;
 }
 
+// Batch decode. Blocks are bucketed by mode (a counting sort over up to BC7_BATCH_SIZE blocks) so each mode's
+// decoder runs back to back on its own blocks instead of dispatching per block.
+static const uint32_t BC7_BATCH_SIZE = 64;
+
+static inline void store_bc7_block(const color_rgba *pPixels, uint8_t *pDst, size_t dst_pitch)
+{
+	for (uint32_t y = 0; y < 4; y++)
+		memcpy(pDst + y * dst_pitch, pPixels + y * 4, 4 * sizeof(color_rgba));
+}
+
+// Runs one mode's decoder over its bucket. Returns the number of blocks it rejected.
+template <typename Unpack>
+static inline uint32_t unpack_bc7_bucket(const uint8_t *pSrc, const uint8_t *pOrder, uint32_t count, uint8_t *pOut, size_t dst_pitch, const color_rgba *pInvalid_pixels, Unpack unpack)
+{
+	uint32_t num_invalid = 0;
+	for (uint32_t j = 0; j < count; j++)
+	{
+		uint64_t data_chunks[2];
+		load_bc7_chunks(pSrc + pOrder[j] * 16, data_chunks);
+
+		color_rgba pixels[16];
+		const bool ok = unpack(data_chunks, pixels);
+		num_invalid += !ok;
+		store_bc7_block(ok ? pixels : pInvalid_pixels, pOut + pOrder[j] * 4 * sizeof(color_rgba), dst_pitch);
+	}
+	return num_invalid;
+}
+
+#ifdef BC7DECOMP_USE_AVX2
+// AVX2 kernels for the two modes that dominate real content (6 and 5). One block fills a 256-bit register: the block
+// is broadcast to both 128-bit lanes, a pshufb gathers the 32-bit window holding each endpoint field (lane 0 = endpoint 0,
+// lane 1 = endpoint 1, slots R G B A) and a variable shift + mask extracts them. The palette is interpolated in 16-bit
+// lanes and looked up per pixel with vpermd on indices shifted into place with vpsrlvd, then written straight to
+// the destination rows. Results match unpack_bc7_mode6() / unpack_bc7_mode4_5() exactly.
+
+static inline __m256i bc7_load_block_avx2(const uint8_t *pBlock)
+{
+	return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pBlock)));
+}
+
+// Interpolates 4 palette entries: lane 0 gets weights w0/w1, lane 1 weights w2/w3 (16-bit RGBA per entry).
+static inline __m256i bc7_interp4_avx2(__m256i ep0, __m256i ep1, int w0, int w1, int w2, int w3)
+{
+	const __m256i w = _mm256_setr_epi16(
+		(short)w0, (short)w0, (short)w0, (short)w0, (short)w1, (short)w1, (short)w1, (short)w1,
+		(short)w2, (short)w2, (short)w2, (short)w2, (short)w3, (short)w3, (short)w3, (short)w3);
+	const __m256i iw = _mm256_sub_epi16(_mm256_set1_epi16(64), w);
+	return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(ep0, iw), _mm256_mullo_epi16(ep1, w)), _mm256_set1_epi16(32)), 6);
+}
+
+// 8-bit endpoints (lane 0 = endpoint 0, lane 1 = endpoint 1, one 32-bit slot per channel) -> both endpoints
+// replicated across both lanes as 16-bit RGBARGBA.
+static inline void bc7_endpoints_avx2(__m256i e, __m256i *pEp0, __m256i *pEp1)
+{
+	const __m256i e16 = _mm256_packus_epi32(e, e);
+	*pEp0 = _mm256_permute2x128_si256(e16, e16, 0x00);
+	*pEp1 = _mm256_permute2x128_si256(e16, e16, 0x11);
+}
+
+static inline void bc7_store_rows_avx2(uint8_t *pDst, size_t dst_pitch, __m256i rows01, __m256i rows23)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(pDst), _mm256_castsi256_si128(rows01));
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + dst_pitch), _mm256_extracti128_si256(rows01, 1));
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + 2 * dst_pitch), _mm256_castsi256_si128(rows23));
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + 3 * dst_pitch), _mm256_extracti128_si256(rows23, 1));
+}
+
+static void unpack_bc7_mode6_avx2(const uint8_t *pBlock, uint8_t *pDst, size_t dst_pitch)
+{
+	uint64_t data_chunks[2];
+	load_bc7_chunks(pBlock, data_chunks);
+
+	// 7-bit fields: R0 @7 G0 @21 B0 @35 A0 @49 | R1 @14 G1 @28 B1 @42 A1 @56
+	const __m256i block = bc7_load_block_avx2(pBlock);
+	const __m256i gather = _mm256_setr_epi8(
+		0, 1, 2, 3,  2, 3, 4, 5,  4, 5, 6, 7,  6, 7, 8, 9,
+		1, 2, 3, 4,  3, 4, 5, 6,  5, 6, 7, 8,  7, 8, 9, 10);
+	__m256i e = _mm256_srlv_epi32(_mm256_shuffle_epi8(block, gather), _mm256_setr_epi32(7, 5, 3, 1, 6, 4, 2, 0));
+	e = _mm256_and_si256(e, _mm256_set1_epi32(0x7F));
+
+	const int p0 = static_cast<int>(data_chunks[0] >> 63), p1 = static_cast<int>(data_chunks[1] & 1);
+	e = _mm256_or_si256(_mm256_slli_epi32(e, 1), _mm256_setr_epi32(p0, p0, p0, p0, p1, p1, p1, p1));
+
+	__m256i ep0, ep1;
+	bc7_endpoints_avx2(e, &ep0, &ep1);
+
+	// Palette entries 0-7 and 8-15, in vpermd slot order
+	const __m256i lo = _mm256_packus_epi16(bc7_interp4_avx2(ep0, ep1, 0, 4, 17, 21), bc7_interp4_avx2(ep0, ep1, 9, 13, 26, 30));
+	const __m256i hi = _mm256_packus_epi16(bc7_interp4_avx2(ep0, ep1, 34, 38, 51, 55), bc7_interp4_avx2(ep0, ep1, 43, 47, 60, 64));
+
+	// 4-bit indices from bit 65; pixel 0 (the anchor) has 3
+	uint64_t weights = data_chunks[1] >> 1;
+	weights = ((weights & ~7ULL) << 1) | (weights & 7);
+
+	const __m256i shifts = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+	__m256i rows[2];
+	for (uint32_t r = 0; r < 2; r++)
+	{
+		const __m256i idx = _mm256_srlv_epi32(_mm256_set1_epi32(static_cast<int>(weights >> (32 * r))), shifts);
+		const __m256 use_hi = _mm256_castsi256_ps(_mm256_slli_epi32(idx, 28));
+		rows[r] = _mm256_castps_si256(_mm256_blendv_ps(
+			_mm256_castsi256_ps(_mm256_permutevar8x32_epi32(lo, idx)),
+			_mm256_castsi256_ps(_mm256_permutevar8x32_epi32(hi, idx)), use_hi));
+	}
+
+	bc7_store_rows_avx2(pDst, dst_pitch, rows[0], rows[1]);
+}
+
+static void unpack_bc7_mode5_avx2(const uint8_t *pBlock, uint8_t *pDst, size_t dst_pitch)
+{
+	uint64_t data_chunks[2];
+	load_bc7_chunks(pBlock, data_chunks);
+
+	// R0 @8 G0 @22 B0 @36 A0 @50 | R1 @15 G1 @29 B1 @43 A1 @58; color fields are 7 bits, alpha 8
+	const __m256i block = bc7_load_block_avx2(pBlock);
+	const __m256i gather = _mm256_setr_epi8(
+		1, 2, 3, 4,  2, 3, 4, 5,  4, 5, 6, 7,  6, 7, 8, 9,
+		1, 2, 3, 4,  3, 4, 5, 6,  5, 6, 7, 8,  7, 8, 9, 10);
+	__m256i e = _mm256_srlv_epi32(_mm256_shuffle_epi8(block, gather), _mm256_setr_epi32(0, 6, 4, 2, 7, 5, 3, 2));
+	e = _mm256_and_si256(e, _mm256_setr_epi32(0x7F, 0x7F, 0x7F, 0xFF, 0x7F, 0x7F, 0x7F, 0xFF));
+
+	// Dequantize color (7 -> 8 bits); alpha is already 8 bits
+	const __m256i dq = _mm256_or_si256(_mm256_slli_epi32(e, 1), _mm256_srli_epi32(e, 6));
+	e = _mm256_blend_epi32(dq, e, 0x88);
+
+	__m256i ep0, ep1;
+	bc7_endpoints_avx2(e, &ep0, &ep1);
+
+	// Color and alpha both use 2-bit weights, so one 4-entry palette serves both; entries 0-3 repeat in slots 4-7
+	const __m256i pal4 = _mm256_packus_epi16(bc7_interp4_avx2(ep0, ep1, 0, 21, 43, 64), _mm256_setzero_si256());
+	const __m256i pal = _mm256_permute4x64_epi64(pal4, _MM_SHUFFLE(2, 0, 2, 0));
+
+	// 2-bit color indices from bit 66 and alpha indices from bit 97; pixel 0 (the anchor) has 1 bit in each
+	uint64_t c_weights = (data_chunks[1] >> 2) & 0x7FFFFFFF;
+	uint64_t a_weights = data_chunks[1] >> 33;
+	c_weights = ((c_weights & ~1ULL) << 1) | (c_weights & 1);
+	a_weights = ((a_weights & ~1ULL) << 1) | (a_weights & 1);
+
+	// Rotation swaps alpha with R, G or B after the lookup
+	static const int8_t s_rotations[4][16] =
+	{
+		{ 0, 1, 2, 3,  4, 5, 6, 7,  8, 9, 10, 11,  12, 13, 14, 15 },
+		{ 3, 1, 2, 0,  7, 5, 6, 4,  11, 9, 10, 8,  15, 13, 14, 12 },
+		{ 0, 3, 2, 1,  4, 7, 6, 5,  8, 11, 10, 9,  12, 15, 14, 13 },
+		{ 0, 1, 3, 2,  4, 5, 7, 6,  8, 9, 11, 10,  12, 13, 15, 14 },
+	};
+	const uint32_t comp_rot = static_cast<uint32_t>(data_chunks[0] >> 6) & 3;
+	const __m256i rot = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s_rotations[comp_rot])));
+
+	// vpermd only looks at the low 3 bits; bit 2 lands in the repeated half of the palette
+	const __m256i shifts = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+	const __m256i alpha_mask = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+	__m256i rows[2];
+	for (uint32_t r = 0; r < 2; r++)
+	{
+		const __m256i color = _mm256_permutevar8x32_epi32(pal, _mm256_srlv_epi32(_mm256_set1_epi32(static_cast<int>(c_weights >> (16 * r))), shifts));
+		const __m256i alpha = _mm256_permutevar8x32_epi32(pal, _mm256_srlv_epi32(_mm256_set1_epi32(static_cast<int>(a_weights >> (16 * r))), shifts));
+		rows[r] = _mm256_shuffle_epi8(_mm256_or_si256(_mm256_andnot_si256(alpha_mask, color), _mm256_and_si256(alpha_mask, alpha)), rot);
+	}
+
+	bc7_store_rows_avx2(pDst, dst_pitch, rows[0], rows[1]);
+}
+
+template <typename Unpack>
+static inline void unpack_bc7_bucket_avx2(const uint8_t *pSrc, const uint8_t *pOrder, uint32_t count, uint8_t *pOut, size_t dst_pitch, Unpack unpack)
+{
+	for (uint32_t j = 0; j < count; j++)
+		unpack(pSrc + pOrder[j] * 16, pOut + pOrder[j] * 4 * sizeof(color_rgba), dst_pitch);
+}
+#endif
+
+uint32_t unpack_bc7_blocks(const void *pBlocks, size_t num_blocks, void *pDst, size_t dst_pitch, const color_rgba &invalid_color)
+{
+	const uint8_t *pSrc = static_cast<const uint8_t *>(pBlocks);
+	uint8_t *pOut = static_cast<uint8_t *>(pDst);
+	uint32_t total_invalid = 0;
+
+	color_rgba invalid_pixels[16];
+	for (uint32_t i = 0; i < 16; i++)
+		invalid_pixels[i] = invalid_color;
+
+	for (size_t base = 0; base < num_blocks; base += BC7_BATCH_SIZE)
+	{
+		const uint32_t n = static_cast<uint32_t>(std::min<size_t>(num_blocks - base, BC7_BATCH_SIZE));
+		const uint8_t *pBatch = pSrc + base * 16;
+		uint8_t *pBatch_out = pOut + base * 4 * sizeof(color_rgba);
+
+		// Bucket the block indices by mode (8 = invalid first byte)
+		uint32_t mode_start[10] = { 0 };
+		for (uint32_t i = 0; i < n; i++)
+			mode_start[g_bc7_first_byte_to_mode[pBatch[i * 16]] + 1]++;
+		for (uint32_t m = 1; m < 10; m++)
+			mode_start[m] += mode_start[m - 1];
+
+		uint8_t order[BC7_BATCH_SIZE];
+		uint32_t fill[9];
+		memcpy(fill, mode_start, sizeof(fill));
+		for (uint32_t i = 0; i < n; i++)
+			order[fill[g_bc7_first_byte_to_mode[pBatch[i * 16]]]++] = static_cast<uint8_t>(i);
+
+#define BC7_BUCKET(m, unpack_expr) \
+		total_invalid += unpack_bc7_bucket(pBatch, order + mode_start[m], mode_start[(m) + 1] - mode_start[m], pBatch_out, dst_pitch, invalid_pixels, \
+			[](const uint64_t *data_chunks, color_rgba *pPixels) { return unpack_expr; })
+
+		BC7_BUCKET(0, unpack_bc7_mode0_2(0, data_chunks, pPixels));
+		BC7_BUCKET(1, unpack_bc7_mode1_3_7(1, data_chunks, pPixels));
+		BC7_BUCKET(2, unpack_bc7_mode0_2(2, data_chunks, pPixels));
+		BC7_BUCKET(3, unpack_bc7_mode1_3_7(3, data_chunks, pPixels));
+		BC7_BUCKET(4, unpack_bc7_mode4_5(4, data_chunks, pPixels));
+#ifdef BC7DECOMP_USE_AVX2
+		unpack_bc7_bucket_avx2(pBatch, order + mode_start[5], mode_start[6] - mode_start[5], pBatch_out, dst_pitch, unpack_bc7_mode5_avx2);
+		unpack_bc7_bucket_avx2(pBatch, order + mode_start[6], mode_start[7] - mode_start[6], pBatch_out, dst_pitch, unpack_bc7_mode6_avx2);
+#else
+		BC7_BUCKET(5, unpack_bc7_mode4_5(5, data_chunks, pPixels));
+		BC7_BUCKET(6, unpack_bc7_mode6(data_chunks, pPixels));
+#endif
+		BC7_BUCKET(7, unpack_bc7_mode1_3_7(7, data_chunks, pPixels));
+		BC7_BUCKET(8, ((void)data_chunks, (void)pPixels, false));
+#undef BC7_BUCKET
+	}
+
+	return total_invalid;
+}
+
 } // namespace bc7decomp
 
 /*
@@ -167,6 +167,11 @@ public:
 
 bool unpack_bc7(const void *pBlock, color_rgba *pPixels);
 
+// Unpacks num_blocks consecutive 16-byte BC7 blocks forming one horizontal strip: block i goes to the 4x4 pixels
+// at pDst + i * 16 bytes, with dst_pitch bytes between pixel rows. Invalid blocks are filled with invalid_color.
+// Returns the number of invalid blocks.
+uint32_t unpack_bc7_blocks(const void *pBlocks, size_t num_blocks, void *pDst, size_t dst_pitch, const color_rgba &invalid_color);
+
 } // namespace bc7decomp
 
 namespace bc7decomp_ref
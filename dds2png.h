@@ -0,0 +1,142 @@
+#ifndef DDS2PNG_H
+#define DDS2PNG_H
+
+// Public interface of dds_bc_all_to_png.c (used by batch_dds2png.cpp).
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// PNG scanline filter (dds2png_options::filter). 0-4 are the PNG filter types.
+#define DDS2PNG_FILTER_NONE     0
+#define DDS2PNG_FILTER_SUB      1
+#define DDS2PNG_FILTER_UP       2
+#define DDS2PNG_FILTER_AVG      3
+#define DDS2PNG_FILTER_PAETH    4
+#define DDS2PNG_FILTER_ADAPTIVE 5 // per row, minimum sum of absolute differences
+
+// deflate strategy (dds2png_options::strategy). Any other value is passed to
+// zlib as-is: Z_DEFAULT_STRATEGY (0), Z_FILTERED (1), Z_HUFFMAN_ONLY (2),
+// Z_RLE (3), Z_FIXED (4).
+#define DDS2PNG_STRATEGY_AUTO -1 // Z_RLE for BC4, Z_FILTERED for filtered rows
+
+// BC5 output (dds2png_options::bc5_output).
+#define DDS2PNG_BC5_RGB 0 // RGB PNG with Z rebuilt from X/Y
+#define DDS2PNG_BC5_XY  1 // gray+alpha PNG holding X/Y only
+
+// Parallel-for hook (dds2png_options::parallel_for): run fn(arg, i) for every
+// i in [0, count), using up to `threads` threads, and return once all have
+// finished. Tasks of one call touch disjoint memory; the calling thread may
+// run them too.
+typedef void (*dds2png_task_fn)(void* arg, size_t index);
+typedef void (*dds2png_parallel_for_fn)(void* pool, int threads, size_t count, dds2png_task_fn fn, void* arg);
+
+typedef struct dds2png_options {
+    int level;             // zlib level, 0-9
+    int strategy;          // DDS2PNG_STRATEGY_AUTO or a zlib strategy
+    int mem_level;         // zlib memLevel, 1-9
+    int window_bits;       // zlib windowBits, 9-15
+    int filter;            // DDS2PNG_FILTER_*
+    double time_budget_ms; // > 0: pick the level per image so the encode
+                           // of its pixel count fits the budget; 'level'
+                           // is then the upper bound
+    int threads;           // threads one conversion may use (1 = serial);
+                           // block rows decode in parallel and large
+                           // images deflate in parallel segments
+    int bc5_output;        // DDS2PNG_BC5_*
+    uint32_t max_dim;      // > 0: thumbnail, convert the smallest mip whose
+                           // longer side is still >= max_dim (mip 0 when
+                           // the file has no smaller one); only that mip
+                           // is read. If a quarter of it is still that
+                           // large, it is converted at one pixel per 4x4
+                           // block (the block mean). 0 = mip 0
+    dds2png_parallel_for_fn parallel_for; // runs the decode bands and deflate
+                                          // segments; NULL = own threads
+    void* parallel_pool;   // first argument of parallel_for
+} dds2png_options;
+
+// Defaults: the "balanced" preset.
+void dds2png_options_init(dds2png_options* opts);
+
+// Named presets: "fast", "balanced", "archive". Returns 0, or 1 for an
+// unknown name (opts untouched).
+int dds2png_options_preset(dds2png_options* opts, const char* name);
+
+// Shared command-line parsing for the compression flags
+//     --preset NAME  --level N  --strategy NAME  --mem-level N
+//     --window-bits N  --filter NAME  --time-budget MS  --bc5 rgb|xy
+//     --max-dim N
+// 'value' is the argument following 'flag' (may be NULL). Returns the number
+// of arguments consumed (2), 0 if 'flag' is not one of these, or -1 for a
+// missing or invalid value (an error has been printed).
+int dds2png_parse_option(dds2png_options* opts, const char* flag, const char* value);
+
+// Convert one DDS file to PNG. Returns 0 on success, 1 on failure.
+int dds2png_convert(const char* input, const char* output);
+int dds2png_convert_ex(const char* input, const char* output, const dds2png_options* opts);
+
+// What dds2png_probe learns from a file's header alone.
+typedef struct dds2png_probe_info {
+    uint32_t width;  // of the mip the options select (the PNG's size)
+    uint32_t height;
+    uint32_t dxgi;  // DXGI format (71 = BC1 ... 98 = BC7)
+    double est_ms;  // rough single-core conversion time under the options
+    uint64_t file_size;
+} dds2png_probe_info;
+
+// Read only the 148-byte DDS + DX10 header of `input` (opts may be NULL for
+// the defaults). Returns 0, or 1 for an unreadable or unsupported file;
+// nothing is printed, the conversion reports the error.
+int dds2png_probe(const char* input, const dds2png_options* opts, dds2png_probe_info* info);
+
+// Decoder fast-path counters for one format, totals over every conversion
+// the process has run so far (all threads).
+typedef struct dds2png_block_stats {
+    uint64_t blocks;   // 4x4 blocks decoded
+    uint64_t uniform;  // one-color blocks splat-filled without a decode
+    uint64_t repeated; // blocks byte-identical to the previous one in their
+                       // row, copied from its pixels
+} dds2png_block_stats;
+
+// Counters of DXGI format `dxgi`. Returns 0, or 1 for an unsupported format
+// (stats zeroed).
+int dds2png_get_block_stats(uint32_t dxgi, dds2png_block_stats* stats);
+
+// Conversion state kept between calls: scratch buffers that grow to the
+// largest image seen and a zlib deflate stream that is reset, not rebuilt,
+// while the settings stay the same. One context per thread; a context must
+// not be used by two conversions at once.
+typedef struct dds2png_context dds2png_context;
+
+dds2png_context* dds2png_context_create(void); // NULL when out of memory
+void dds2png_context_destroy(dds2png_context* ctx);
+
+// dds2png_convert_ex reusing ctx. A NULL ctx or opts falls back to
+// dds2png_convert_ex (a one-off context, default options).
+int dds2png_convert_ctx(dds2png_context* ctx, const char* input, const char* output, const dds2png_options* opts);
+
+// dds2png_convert_ctx that also sets *input_crc to the zlib crc32 of the
+// whole input file, hashed from the mapping the conversion decodes so the
+// file is read once. With max_dim that reads every mip, not just one. ctx
+// and opts must not be NULL.
+int dds2png_convert_crc(dds2png_context* ctx, const char* input, const char* output,
+                        const dds2png_options* opts, uint32_t* input_crc);
+
+// Receives the PNG bytes of dds2png_convert_memory in order, a piece at a
+// time. Returns 0, or nonzero to fail the conversion.
+typedef int (*dds2png_write_fn)(void* user, const void* data, size_t len);
+
+// Convert a DDS file the caller has already read: `size` bytes at `data`,
+// decoded in place. The PNG goes to write(user, ...) as it is encoded;
+// `name` only labels error messages. ctx and opts may be NULL.
+int dds2png_convert_memory(dds2png_context* ctx, const void* data, size_t size, const char* name,
+                           dds2png_write_fn write, void* user, const dds2png_options* opts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
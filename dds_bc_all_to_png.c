@@ -5,21 +5,26 @@
 // - BC2_UNORM (74) -> RGBA PNG (DXT3)
 // - BC3_UNORM (77) -> RGBA PNG (DXT5)
 // - BC4_UNORM (80) -> grayscale PNG
-// - BC5_UNORM (83) -> RGB PNG (normal map)
+// - BC5_UNORM (83) -> RGB PNG (normal map), or gray+alpha X/Y with --bc5 xy
 // - BC7_UNORM (98) -> RGBA PNG
 //
 // No libpng, no external tools. Only dependency: zlib.
 //
-// Public entry point (used by batch_dds2png.cpp):
-//     extern "C" int dds2png_convert(const char* input, const char* output);
+// Public entry points (declared in dds2png.h, used by batch_dds2png.cpp):
+//     int dds2png_convert(const char* input, const char* output);
+//     int dds2png_convert_ex(const char* input, const char* output, const dds2png_options* opts);
 //
 // Standalone build usage (if STANDALONE is defined):
-//     dds2png in.dds out.png
+//     dds2png [--preset fast|balanced|archive] [...] in.dds out.png
 //
 // Example builds:
 //   g++ -std=c++17 -O2 dds_bc_all_to_png.c bc7_decoder.cpp bc7decomp.cpp -o dds2png -lz -lm
 //   g++ -std=c++17 -O2 batch_dds2png.cpp dds_bc_all_to_png.c bc7_decoder.cpp bc7decomp.cpp -o batch_dds2png -lz -lm -lpthread
 
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE // madvise()
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -27,6 +32,18 @@
 #include <math.h>
 #include <zlib.h>
 
+#include "dds2png.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DDS2PNG_HAVE_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <pthread.h>
+
 // ----------------------- DDS Structures & Constants -----------------------
 
 #define DDS_MAGIC 0x20534444u
@@ -80,48 +97,661 @@ typedef struct {
 
 #pragma pack(pop)
 
+// Offset of the first block: magic + DDS_HEADER + DDS_HEADER_DX10 (148 bytes)
+#define DDS_DX10_DATA_OFFSET (4u + sizeof(DDS_HEADER) + sizeof(DDS_HEADER_DX10))
+
+// ----------------------- Input Mapping -----------------------
+//
+// The whole DDS file is mapped read-only and the decoders read headers and
+// blocks straight out of the mapping, so the payload is never copied into a
+// private buffer. Platforms without mmap fall back to one fread of the file.
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    void* map;     // mmap base (NULL when heap-backed)
+    uint8_t* heap; // fallback buffer (NULL when mapped)
+} dds_input;
+
+static int dds_input_open(dds_input* in, const char* path)
+{
+    memset(in, 0, sizeof(*in));
+
+#ifdef DDS2PNG_HAVE_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return 1;
+    }
+
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 1;
+
+    // Only the header page for now: readahead from it could pull in mips
+    // that are never decoded. dds_input_will_read() asks for the blocks
+    // once the mip is known.
+    madvise(map, (size_t)st.st_size, MADV_RANDOM);
+
+    in->map  = map;
+    in->data = (const uint8_t*)map;
+    in->size = (size_t)st.st_size;
+    return 0;
+#else
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return 1;
+
+    long len = -1;
+    if (fseek(f, 0, SEEK_END) == 0)
+        len = ftell(f);
+    if (len <= 0 || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return 1;
+    }
+
+    in->heap = (uint8_t*)malloc((size_t)len);
+    if (!in->heap || fread(in->heap, 1, (size_t)len, f) != (size_t)len) {
+        free(in->heap);
+        in->heap = NULL;
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    in->data = in->heap;
+    in->size = (size_t)len;
+    return 0;
+#endif
+}
+
+// Prefetch the `len` bytes at `offset`, the only part of the file a
+// conversion reads beyond the header.
+static void dds_input_will_read(const dds_input* in, size_t offset, size_t len)
+{
+#ifdef DDS2PNG_HAVE_MMAP
+    if (!in->map || len == 0)
+        return;
+    // Blocks are consumed once, front to back
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t start = offset / page * page;
+    madvise((uint8_t*)in->map + start, offset + len - start, MADV_SEQUENTIAL);
+    madvise((uint8_t*)in->map + start, offset + len - start, MADV_WILLNEED);
+#else
+    (void)in; (void)offset; (void)len;
+#endif
+}
+
+static void dds_input_close(dds_input* in)
+{
+#ifdef DDS2PNG_HAVE_MMAP
+    if (in->map)
+        munmap(in->map, in->size);
+#endif
+    free(in->heap);
+    memset(in, 0, sizeof(*in));
+}
+
 // ----------------------- External BC7 Decoder -----------------------
 //
 // Implemented in bc7_decoder.cpp and backed by bc7decomp.cpp
 
-#ifdef __cplusplus
-extern "C" {
-    #endif
-    void bc7_decode_block(const uint8_t block[16], uint8_t out_rgba[16 * 4]);
-    #ifdef __cplusplus
+#include "bc7_decoder.h"
+
+// ----------------------- Parallel For -----------------------
+//
+// Runs fn(arg, 0..count-1) on up to `threads` threads, the caller included.
+// Indices are handed out one at a time from a shared counter, so uneven
+// tasks balance themselves. Falls back to the calling thread alone if no
+// worker can be started. A caller with a thread pool of its own can take
+// these tasks over through dds2png_options::parallel_for.
+
+typedef dds2png_task_fn dds_task_fn;
+
+typedef struct {
+    dds_task_fn fn;
+    void* arg;
+    size_t count;
+    size_t next; // shared, claimed with __atomic_fetch_add
+} dds_parallel_job;
+
+static void dds_parallel_drain(dds_parallel_job* job)
+{
+    for (;;) {
+        size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->count)
+            return;
+        job->fn(job->arg, i);
+    }
+}
+
+static void* dds_parallel_worker(void* p)
+{
+    dds_parallel_drain((dds_parallel_job*)p);
+    return NULL;
+}
+
+#define DDS_MAX_THREADS 64
+
+static void dds_parallel_for(int threads, size_t count, dds_task_fn fn, void* arg)
+{
+    dds_parallel_job job = { fn, arg, count, 0 };
+
+    size_t helpers = (threads > 1) ? (size_t)threads - 1 : 0;
+    if (helpers > count - (count > 0))
+        helpers = count - (count > 0);
+    if (helpers > DDS_MAX_THREADS - 1)
+        helpers = DDS_MAX_THREADS - 1;
+
+    pthread_t tid[DDS_MAX_THREADS];
+    size_t started = 0;
+    for (; started < helpers; ++started) {
+        if (pthread_create(&tid[started], NULL, dds_parallel_worker, &job) != 0)
+            break;
+    }
+
+    dds_parallel_drain(&job);
+
+    for (size_t i = 0; i < started; ++i)
+        pthread_join(tid[i], NULL);
+}
+
+// dds_parallel_for, or the pool in the options when there is one.
+static void dds_options_parallel_for(const dds2png_options* o, int threads, size_t count, dds_task_fn fn, void* arg)
+{
+    if (o->parallel_for && threads > 1)
+        o->parallel_for(o->parallel_pool, threads, count, fn, arg);
+    else
+        dds_parallel_for(threads, count, fn, arg);
+}
+
+// ----------------------- PNG Scanline Filters -----------------------
+//
+// Filter types from the PNG spec (DDS2PNG_FILTER_* in dds2png.h). Encoding is data-parallel (every output byte
+// only depends on unfiltered input), so each filter is a straight vector loop
+// with unaligned loads at x - bpp; this covers 1-, 3- and 4-byte pixels alike.
+
+#if (defined(_M_AMD64) || defined(_M_X64) || defined(__SSE2__))
+#define DDS2PNG_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+static const char* const g_png_filter_names[6] = { "none", "sub", "up", "avg", "paeth", "adaptive" };
+
+static inline uint8_t png_paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+    int p  = (int)a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+#ifdef DDS2PNG_USE_SSE2
+static inline __m128i png_abs_epi16_sse2(__m128i v)
+{
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+// Paeth predictor on 8 pixels' worth of 16-bit lanes.
+static inline __m128i png_paeth_epi16_sse2(__m128i a, __m128i b, __m128i c)
+{
+    __m128i pa = png_abs_epi16_sse2(_mm_sub_epi16(b, c));
+    __m128i pb = png_abs_epi16_sse2(_mm_sub_epi16(a, c));
+    __m128i pc = png_abs_epi16_sse2(_mm_sub_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, c)));
+
+    // a if pa <= pb && pa <= pc, else b if pb <= pc, else c
+    __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    __m128i not_b = _mm_cmpgt_epi16(pb, pc);
+    __m128i bc = _mm_or_si128(_mm_andnot_si128(not_b, b), _mm_and_si128(not_b, c));
+    return _mm_or_si128(_mm_andnot_si128(not_a, a), _mm_and_si128(not_a, bc));
+}
+#endif
+
+// Filter one row of `n` bytes. `prev` is the previous unfiltered row (all
+// zeros for the first row). Writes n bytes to `out` (no filter type byte).
+static void png_filter_row(int type, uint32_t bpp, const uint8_t* cur, const uint8_t* prev, uint8_t* out, size_t n)
+{
+    size_t i = 0;
+
+    if (type == DDS2PNG_FILTER_NONE) {
+        memcpy(out, cur, n);
+        return;
+    }
+
+    if (type == DDS2PNG_FILTER_UP) {
+#ifdef DDS2PNG_USE_SSE2
+        for (; i + 16 <= n; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(cur + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+            _mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi8(x, b));
+        }
+#endif
+        for (; i < n; ++i)
+            out[i] = (uint8_t)(cur[i] - prev[i]);
+        return;
+    }
+
+    // Leading pixel: left (a) and upper-left (c) neighbours are zero.
+    for (; i < bpp && i < n; ++i) {
+        switch (type) {
+        case DDS2PNG_FILTER_SUB:   out[i] = cur[i]; break;
+        case DDS2PNG_FILTER_AVG:   out[i] = (uint8_t)(cur[i] - (prev[i] >> 1)); break;
+        default:               out[i] = (uint8_t)(cur[i] - prev[i]); break; // Paeth(0, b, 0) == b
+        }
+    }
+
+    switch (type) {
+    case DDS2PNG_FILTER_SUB:
+#ifdef DDS2PNG_USE_SSE2
+        for (; i + 16 <= n; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(cur + i));
+            __m128i a = _mm_loadu_si128((const __m128i*)(cur + i - bpp));
+            _mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi8(x, a));
+        }
+#endif
+        for (; i < n; ++i)
+            out[i] = (uint8_t)(cur[i] - cur[i - bpp]);
+        break;
+
+    case DDS2PNG_FILTER_AVG:
+#ifdef DDS2PNG_USE_SSE2
+        for (; i + 16 <= n; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(cur + i));
+            __m128i a = _mm_loadu_si128((const __m128i*)(cur + i - bpp));
+            __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+            // floor((a + b) / 2): pavgb rounds up, so take back the odd bit
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+            _mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi8(x, avg));
+        }
+#endif
+        for (; i < n; ++i)
+            out[i] = (uint8_t)(cur[i] - ((cur[i - bpp] + prev[i]) >> 1));
+        break;
+
+    case DDS2PNG_FILTER_PAETH:
+#ifdef DDS2PNG_USE_SSE2
+        for (; i + 16 <= n; i += 16) {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i x = _mm_loadu_si128((const __m128i*)(cur + i));
+            __m128i a = _mm_loadu_si128((const __m128i*)(cur + i - bpp));
+            __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+            __m128i c = _mm_loadu_si128((const __m128i*)(prev + i - bpp));
+
+            __m128i lo = png_paeth_epi16_sse2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+            __m128i hi = png_paeth_epi16_sse2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+            _mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi8(x, _mm_packus_epi16(lo, hi)));
+        }
+#endif
+        for (; i < n; ++i)
+            out[i] = (uint8_t)(cur[i] - png_paeth(cur[i - bpp], prev[i], prev[i - bpp]));
+        break;
+
+    default:
+        break;
+    }
 }
+
+// Sum of the filtered bytes read as signed values (the libpng heuristic).
+static uint64_t png_row_cost(const uint8_t* p, size_t n)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+#ifdef DDS2PNG_USE_SSE2
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        // |(int8_t)v| == min(v, -v) on unsigned bytes
+        __m128i m = _mm_min_epu8(v, _mm_sub_epi8(_mm_setzero_si128(), v));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(m, _mm_setzero_si128()));
+    }
+    sum = (uint64_t)_mm_cvtsi128_si32(acc) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
 #endif
+    for (; i < n; ++i)
+        sum += (p[i] < 128) ? p[i] : 256u - p[i];
+    return sum;
+}
+
+// ----------------------- Conversion Context -----------------------
+//
+// State a caller can keep across conversions (see dds2png_convert_ctx):
+//
+//  - an arena for every per-image buffer. Allocation is a pointer bump;
+//    requests that do not fit are malloc'd on the side, and the next reset
+//    regrows the block to the total, so once the largest image has been seen
+//    a conversion does no heap allocation at all.
+//  - the serial deflate stream. deflateInit2 allocates ~256 KiB of window and
+//    hash tables; when the settings match the previous image's the stream is
+//    deflateReset instead.
+
+// Blocks and spills come from aligned_alloc(DDS_ARENA_ALIGN, n), n a
+// multiple of it.
+#define DDS_ARENA_ALIGN 64
+
+typedef struct dds_arena_spill {
+    struct dds_arena_spill* next;
+} dds_arena_spill;
+
+typedef struct {
+    uint8_t* base;
+    size_t cap;
+    size_t top;             // bytes carved from base
+    size_t need;            // bytes requested since the last reset, spills included
+    dds_arena_spill* spill; // side allocations, freed on reset
+} dds_arena;
+
+static void* dds_arena_alloc(dds_arena* a, size_t size)
+{
+    size = (size + DDS_ARENA_ALIGN - 1) & ~(size_t)(DDS_ARENA_ALIGN - 1);
+    a->need += size;
+    if (a->cap - a->top >= size) {
+        void* p = a->base + a->top;
+        a->top += size;
+        return p;
+    }
+
+    dds_arena_spill* s = (dds_arena_spill*)aligned_alloc(DDS_ARENA_ALIGN, DDS_ARENA_ALIGN + size);
+    if (!s)
+        return NULL;
+    s->next = a->spill;
+    a->spill = s;
+    return (uint8_t*)s + DDS_ARENA_ALIGN;
+}
+
+static void* dds_arena_calloc(dds_arena* a, size_t size)
+{
+    void* p = dds_arena_alloc(a, size);
+    if (p)
+        memset(p, 0, size);
+    return p;
+}
+
+// Drop everything handed out; grow the block if the last round spilled.
+static void dds_arena_reset(dds_arena* a)
+{
+    while (a->spill) {
+        dds_arena_spill* next = a->spill->next;
+        free(a->spill);
+        a->spill = next;
+    }
+    if (a->need > a->cap) {
+        free(a->base);
+        a->base = (uint8_t*)aligned_alloc(DDS_ARENA_ALIGN, a->need);
+        a->cap = a->base ? a->need : 0;
+    }
+    a->top = 0;
+    a->need = 0;
+}
+
+static void dds_arena_free(dds_arena* a)
+{
+    dds_arena_reset(a);
+    free(a->base);
+    a->base = NULL;
+    a->cap = 0;
+}
+
+struct dds2png_context {
+    dds_arena arena;
+    z_stream zs;        // serial deflate stream
+    int zs_ready;
+    int zs_level;       // settings zs currently has
+    int zs_strategy;
+    int zs_mem_level;
+    int zs_window_bits;
+};
+
+static void dds_context_init(dds2png_context* ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static void dds_context_release(dds2png_context* ctx)
+{
+    if (ctx->zs_ready)
+        deflateEnd(&ctx->zs);
+    ctx->zs_ready = 0;
+    dds_arena_free(&ctx->arena);
+}
+
+// The context's deflate stream, ready for a new zlib stream with settings z.
+static z_stream* dds_context_deflate(dds2png_context* ctx, const dds2png_options* z)
+{
+    if (ctx->zs_ready && ctx->zs_level == z->level && ctx->zs_strategy == z->strategy &&
+        ctx->zs_mem_level == z->mem_level && ctx->zs_window_bits == z->window_bits &&
+        deflateReset(&ctx->zs) == Z_OK)
+        return &ctx->zs;
+
+    if (ctx->zs_ready)
+        deflateEnd(&ctx->zs);
+    ctx->zs_ready = 0;
+
+    memset(&ctx->zs, 0, sizeof(ctx->zs));
+    if (deflateInit2(&ctx->zs, z->level, Z_DEFLATED, z->window_bits, z->mem_level, z->strategy) != Z_OK)
+        return NULL;
+    ctx->zs_ready       = 1;
+    ctx->zs_level       = z->level;
+    ctx->zs_strategy    = z->strategy;
+    ctx->zs_mem_level   = z->mem_level;
+    ctx->zs_window_bits = z->window_bits;
+    return &ctx->zs;
+}
+
+// ----------------------- PNG Stream Writer -----------------------
+//
+// The encoder never sees the whole image: the decoder hands it one band of
+// scanlines at a time (one block row = up to 4 scanlines), each row is
+// filtered and fed to a persistent deflate stream, and the compressed output
+// is emitted as fixed-size IDAT chunks. Peak memory is O(width).
+//
+// With more than one thread and a large image, the filtered bytes are instead
+// cut into PNG_SEGMENT_SIZE segments that are deflated side by side, pigz
+// style: each segment is a raw deflate stream primed with the previous
+// segment's last window as dictionary and ended with a sync flush (the last
+// one with Z_FINISH), so the segments concatenate into one valid zlib stream.
+// Each segment becomes one IDAT chunk whose CRC is computed by the thread that
+// compressed it; the per-segment adler32s are joined with adler32_combine().
+//
+// The PNG goes to a file, or to a write callback piece by piece (memory
+// conversions); with neither the stream only counts bytes (--bench mode).
+
+#define PNG_IDAT_CHUNK_SIZE (64u * 1024u)
+#define PNG_SEGMENT_SIZE    (1024u * 1024u)
+#define PNG_PARALLEL_MIN    (4u * PNG_SEGMENT_SIZE) // smaller images stay serial
 
-// ----------------------- PNG Helper Functions -----------------------
+typedef struct {
+    z_stream zs;
+    int zs_ready;
+    uint8_t* in;        // PNG_SEGMENT_SIZE bytes of filtered scanlines
+    size_t in_len;
+    uint8_t* out;       // [zlib header if first][raw deflate data]
+    size_t out_cap;
+    size_t out_len;
+    uint32_t adler;     // adler32 of in
+    uint32_t crc;       // crc32 of "IDAT" + out
+    int failed;
+} png_segment;
+
+typedef struct {
+    FILE* f;
+    const char* path;
+    dds2png_write_fn write; // used when path is NULL
+    void* write_user;
+    int write_failed;
+    uint64_t bytes_out; // PNG bytes produced so far
+    uint32_t width;
+    uint32_t height;
+    uint32_t rows_done;
+    uint32_t bpp;
+    int filter;         // DDS2PNG_FILTER_*
+    size_t row_bytes;   // width * bpp
+    dds2png_options z;  // resolved deflate settings
+    z_stream* zs;       // the context's stream (serial path)
+    uint8_t* prev;      // last unfiltered row of the previous band
+    uint8_t* line[2];   // [filter byte][filtered bytes...]: best and trial rows
+    uint8_t* idat;      // PNG_IDAT_CHUNK_SIZE bytes of compressed output
+
+    // Parallel deflate (threads > 1)
+    int threads;
+    png_segment* seg;   // [threads]
+    int seg_used;       // segments holding data in the current batch
+    int batch_final;    // current batch ends the stream
+    int header_done;    // zlib header already emitted
+    uint8_t* dict;      // window preceding seg[0] (32 KiB max)
+    size_t dict_len;
+    uint32_t adler;     // running adler32 of all flushed segments
+} png_stream;
+
+static void png_put(png_stream* ps, const void* data, size_t len)
+{
+    if (ps->f)
+        fwrite(data, 1, len, ps->f);
+    else if (ps->write && !ps->write_failed && ps->write(ps->write_user, data, len) != 0)
+        ps->write_failed = 1;
+    ps->bytes_out += len;
+}
 
-static void png_write_u32(FILE* f, uint32_t v)
+static void png_write_u32(png_stream* ps, uint32_t v)
 {
     uint8_t b[4];
     b[0] = (uint8_t)((v >> 24) & 0xFF);
     b[1] = (uint8_t)((v >> 16) & 0xFF);
     b[2] = (uint8_t)((v >>  8) & 0xFF);
     b[3] = (uint8_t)( v        & 0xFF);
-    fwrite(b, 1, 4, f);
+    png_put(ps, b, 4);
+}
+
+static void png_write_chunk(png_stream* ps, const char type[4], const uint8_t* data, uint32_t len)
+{
+    png_write_u32(ps, len);
+    png_put(ps, type, 4);
+    if (len)
+        png_put(ps, data, len);
+
+    uint32_t crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef*)type, 4);
+    if (len)
+        crc = crc32(crc, data, len);
+    png_write_u32(ps, crc);
+}
+
+// Buffers live in the context's arena; only the segment streams are owned.
+static void png_stream_release(png_stream* ps)
+{
+    ps->zs = NULL;
+    if (ps->seg) {
+        for (int i = 0; i < ps->threads; ++i) {
+            if (ps->seg[i].zs_ready)
+                deflateEnd(&ps->seg[i].zs);
+        }
+        ps->seg = NULL;
+    }
+}
+
+// Drop a half-written PNG so a failed conversion never looks finished.
+static void png_stream_abort(png_stream* ps)
+{
+    png_stream_release(ps);
+    if (ps->f) {
+        fclose(ps->f);
+        ps->f = NULL;
+        remove(ps->path);
+    }
 }
 
-static int write_png_core(
-    const char* path,
+static int png_stream_begin(
+    png_stream* ps,
+    dds2png_context* ctx,    // buffers and the serial deflate stream
+    const char* path,        // NULL: hand the bytes to write (if any)
+    dds2png_write_fn write,
+    void* write_user,
     uint32_t width,
     uint32_t height,
-    const uint8_t* image,
-    uint8_t color_type,     // 0 = gray, 2 = RGB, 6 = RGBA
-    uint8_t bytes_per_pixel // 1, 3, or 4
+    uint8_t color_type,      // 0 = gray, 2 = RGB, 6 = RGBA
+    uint8_t bytes_per_pixel, // 1, 3, or 4
+    const dds2png_options* z // resolved: no AUTO strategy, final level
 )
 {
-    FILE* f = fopen(path, "wb");
-    if (!f) {
-        fprintf(stderr, "ERROR: Failed to open '%s' for writing\n", path);
+    memset(ps, 0, sizeof(*ps));
+    ps->path      = path;
+    ps->write     = path ? NULL : write;
+    ps->write_user = write_user;
+    ps->width     = width;
+    ps->height    = height;
+    ps->bpp       = bytes_per_pixel;
+    ps->filter    = z->filter;
+    ps->row_bytes = (size_t)width * bytes_per_pixel;
+    ps->z         = *z;
+
+    const uint64_t raw_total = (uint64_t)(ps->row_bytes + 1) * height;
+    ps->threads = (z->threads > 1 && raw_total >= PNG_PARALLEL_MIN) ? z->threads : 1;
+    if (ps->threads > DDS_MAX_THREADS)
+        ps->threads = DDS_MAX_THREADS;
+
+    dds_arena* arena = &ctx->arena;
+    ps->prev    = (uint8_t*)dds_arena_calloc(arena, ps->row_bytes);
+    ps->line[0] = (uint8_t*)dds_arena_alloc(arena, ps->row_bytes + 1);
+    ps->line[1] = (uint8_t*)dds_arena_alloc(arena, ps->row_bytes + 1);
+    int oom = !ps->prev || !ps->line[0] || !ps->line[1];
+
+    if (ps->threads > 1) {
+        ps->seg  = (png_segment*)dds_arena_calloc(arena, (size_t)ps->threads * sizeof(png_segment));
+        ps->dict = (uint8_t*)dds_arena_alloc(arena, (size_t)1 << z->window_bits);
+        ps->adler = adler32(0L, Z_NULL, 0);
+        oom = oom || !ps->seg || !ps->dict;
+        for (int i = 0; !oom && i < ps->threads; ++i) {
+            png_segment* sg = &ps->seg[i];
+            sg->in = (uint8_t*)dds_arena_alloc(arena, PNG_SEGMENT_SIZE);
+            if (!sg->in || deflateInit2(&sg->zs, z->level, Z_DEFLATED, -z->window_bits, z->mem_level, z->strategy) != Z_OK) {
+                oom = 1;
+                break;
+            }
+            sg->zs_ready = 1;
+            // zlib header + deflate worst case + sync flush marker
+            sg->out_cap = 2 + deflateBound(&sg->zs, PNG_SEGMENT_SIZE) + 64;
+            sg->out = (uint8_t*)dds_arena_alloc(arena, sg->out_cap);
+            oom = !sg->out;
+        }
+    } else {
+        ps->idat = (uint8_t*)dds_arena_alloc(arena, PNG_IDAT_CHUNK_SIZE);
+        oom = oom || !ps->idat;
+        if (!oom) {
+            ps->zs = dds_context_deflate(ctx, z);
+            if (!ps->zs) {
+                fprintf(stderr, "ERROR: zlib deflateInit2() failed\n");
+                png_stream_release(ps);
+                return 1;
+            }
+            ps->zs->next_out  = ps->idat;
+            ps->zs->avail_out = PNG_IDAT_CHUNK_SIZE;
+        }
+    }
+
+    if (oom) {
+        fprintf(stderr, "ERROR: Out of memory in png_stream_begin\n");
+        png_stream_release(ps);
         return 1;
     }
 
+    if (path) {
+        ps->f = fopen(path, "wb");
+        if (!ps->f) {
+            fprintf(stderr, "ERROR: Failed to open '%s' for writing\n", path);
+            png_stream_release(ps);
+            return 1;
+        }
+    }
+
     // PNG signature
     static const uint8_t sig[8] = {137,80,78,71,13,10,26,10};
-    fwrite(sig, 1, 8, f);
+    png_put(ps, sig, 8);
 
     // IHDR chunk
     uint8_t ihdr[13];
@@ -141,97 +771,286 @@ static int write_png_core(
     ihdr[11] = 0;            // filter method
     ihdr[12] = 0;            // interlace (none)
 
-    png_write_u32(f, 13);
-    fwrite("IHDR", 1, 4, f);
-    fwrite(ihdr, 1, 13, f);
+    png_write_chunk(ps, "IHDR", ihdr, 13);
+    return 0;
+}
 
-    uint32_t crc = crc32(0L, Z_NULL, 0);
-    crc = crc32(crc, (const Bytef*)"IHDR", 4);
-    crc = crc32(crc, ihdr, 13);
-    png_write_u32(f, crc);
+// Run deflate over whatever is in zs.next_in, emitting every full output
+// buffer as one IDAT chunk. With Z_FINISH, also flushes the final partial one.
+static int png_stream_deflate(png_stream* ps, int flush)
+{
+    for (;;) {
+        int zr = deflate(ps->zs, flush);
+        if (zr != Z_OK && zr != Z_STREAM_END && zr != Z_BUF_ERROR) {
+            fprintf(stderr, "ERROR: zlib deflate() failed\n");
+            return 1;
+        }
 
-    // Build uncompressed scanline buffer: [filter byte][pixel bytes...]
-    const size_t stride_raw = (size_t)width * bytes_per_pixel + 1;
-    const size_t raw_size   = stride_raw * height;
+        if (ps->zs->avail_out == 0 || (zr == Z_STREAM_END && ps->zs->avail_out < PNG_IDAT_CHUNK_SIZE)) {
+            png_write_chunk(ps, "IDAT", ps->idat, PNG_IDAT_CHUNK_SIZE - ps->zs->avail_out);
+            ps->zs->next_out  = ps->idat;
+            ps->zs->avail_out = PNG_IDAT_CHUNK_SIZE;
+        }
 
-    uint8_t* raw = (uint8_t*)malloc(raw_size);
-    if (!raw) {
-        fprintf(stderr, "ERROR: Out of memory in write_png_core raw\n");
-        fclose(f);
-        return 1;
+        if (flush == Z_FINISH) {
+            if (zr == Z_STREAM_END)
+                return 0;
+        } else if (ps->zs->avail_in == 0 && ps->zs->avail_out != 0) {
+            return 0;
+        }
     }
+}
 
-    for (uint32_t y = 0; y < height; ++y) {
-        size_t row_off = (size_t)y * stride_raw;
-        raw[row_off] = 0; // filter type 0 (None)
-        memcpy(&raw[row_off + 1], &image[(size_t)y * width * bytes_per_pixel], width * bytes_per_pixel);
+// Compress one segment of the current batch (runs on a parallel-for thread).
+static void png_segment_compress(void* arg, size_t index)
+{
+    png_stream* ps = (png_stream*)arg;
+    png_segment* sg = &ps->seg[index];
+    const size_t window = (size_t)1 << ps->z.window_bits;
+
+    sg->out_len = 0;
+    sg->failed = 1;
+
+    if (index == 0 && !ps->header_done) {
+        // zlib header: deflate, window size, and the FLEVEL deflate would use
+        int flevel = (ps->z.level < 2 || ps->z.strategy >= Z_HUFFMAN_ONLY) ? 0
+                   : (ps->z.level < 6) ? 1 : (ps->z.level == 6) ? 2 : 3;
+        uint32_t hdr = ((uint32_t)(8 + ((ps->z.window_bits - 8) << 4)) << 8) | ((uint32_t)flevel << 6);
+        hdr += 31 - hdr % 31;
+        sg->out[0] = (uint8_t)(hdr >> 8);
+        sg->out[1] = (uint8_t)hdr;
+        sg->out_len = 2;
     }
 
-    // Compress with zlib
-    uLongf comp_bound = compressBound(raw_size);
-    uint8_t* comp = (uint8_t*)malloc(comp_bound);
-    if (!comp) {
-        fprintf(stderr, "ERROR: Out of memory in write_png_core comp\n");
-        free(raw);
-        fclose(f);
-        return 1;
-    }
+    if (deflateReset(&sg->zs) != Z_OK)
+        return;
 
-    if (compress2(comp, &comp_bound, raw, raw_size, 9) != Z_OK) {
-        fprintf(stderr, "ERROR: zlib compress2() failed\n");
-        free(raw);
-        free(comp);
-        fclose(f);
-        return 1;
+    const uint8_t* dict;
+    size_t dict_len;
+    if (index == 0) {
+        dict = ps->dict;
+        dict_len = ps->dict_len;
+    } else {
+        const png_segment* before = &ps->seg[index - 1];
+        dict_len = before->in_len < window ? before->in_len : window;
+        dict = before->in + before->in_len - dict_len;
     }
+    if (dict_len && deflateSetDictionary(&sg->zs, dict, (uInt)dict_len) != Z_OK)
+        return;
+
+    const int last = ps->batch_final && (int)index == ps->seg_used - 1;
+    sg->zs.next_in   = sg->in;
+    sg->zs.avail_in  = (uInt)sg->in_len;
+    sg->zs.next_out  = sg->out + sg->out_len;
+    sg->zs.avail_out = (uInt)(sg->out_cap - sg->out_len);
+
+    int zr = deflate(&sg->zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+    if (last ? zr != Z_STREAM_END : (zr != Z_OK || sg->zs.avail_out == 0))
+        return;
+
+    sg->out_len = sg->out_cap - sg->zs.avail_out;
+    sg->adler = adler32(adler32(0L, Z_NULL, 0), sg->in, (uInt)sg->in_len);
+    sg->crc = crc32(crc32(0L, Z_NULL, 0), (const Bytef*)"IDAT", 4);
+    sg->crc = crc32(sg->crc, sg->out, (uInt)sg->out_len);
+    sg->failed = 0;
+}
+
+// Compress every filled segment in parallel and emit them in order.
+static int png_stream_flush_segments(png_stream* ps, int final)
+{
+    ps->batch_final = final;
+    dds_options_parallel_for(&ps->z, ps->threads, (size_t)ps->seg_used, png_segment_compress, ps);
 
-    // IDAT chunk
-    png_write_u32(f, (uint32_t)comp_bound);
-    fwrite("IDAT", 1, 4, f);
+    for (int i = 0; i < ps->seg_used; ++i) {
+        png_segment* sg = &ps->seg[i];
+        if (sg->failed) {
+            fprintf(stderr, "ERROR: zlib deflate() failed\n");
+            return 1;
+        }
+        ps->adler = adler32_combine(ps->adler, sg->adler, (z_off_t)sg->in_len);
+
+        if (final && i == ps->seg_used - 1) {
+            // The stream's adler32 trailer goes at the end of the last chunk.
+            uint8_t trailer[4] = {
+                (uint8_t)(ps->adler >> 24), (uint8_t)(ps->adler >> 16),
+                (uint8_t)(ps->adler >> 8),  (uint8_t)ps->adler
+            };
+            png_write_u32(ps, (uint32_t)sg->out_len + 4);
+            png_put(ps, "IDAT", 4);
+            png_put(ps, sg->out, sg->out_len);
+            png_put(ps, trailer, 4);
+            png_write_u32(ps, crc32(sg->crc, trailer, 4));
+        } else {
+            png_write_u32(ps, (uint32_t)sg->out_len);
+            png_put(ps, "IDAT", 4);
+            png_put(ps, sg->out, sg->out_len);
+            png_write_u32(ps, sg->crc);
+        }
+    }
+    ps->header_done = 1;
 
-    crc = crc32(0L, Z_NULL, 0);
-    crc = crc32(crc, (const Bytef*)"IDAT", 4);
-    crc = crc32(crc, comp, comp_bound);
-    fwrite(comp, 1, comp_bound, f);
-    png_write_u32(f, crc);
+    // Keep the tail of the batch as the next batch's dictionary.
+    const png_segment* tail = &ps->seg[ps->seg_used - 1];
+    const size_t window = (size_t)1 << ps->z.window_bits;
+    ps->dict_len = tail->in_len < window ? tail->in_len : window;
+    memcpy(ps->dict, tail->in + tail->in_len - ps->dict_len, ps->dict_len);
 
-    free(raw);
-    free(comp);
+    for (int i = 0; i < ps->seg_used; ++i)
+        ps->seg[i].in_len = 0;
+    ps->seg_used = 0;
+    return 0;
+}
 
-    // IEND chunk
-    png_write_u32(f, 0);
-    fwrite("IEND", 1, 4, f);
-    crc = crc32(0L, Z_NULL, 0);
-    crc = crc32(crc, (const Bytef*)"IEND", 4);
-    png_write_u32(f, crc);
+// Queue filtered bytes for the parallel path. A batch is only compressed once
+// more input arrives, so the final batch always holds the end of the stream.
+static int png_stream_queue(png_stream* ps, const uint8_t* data, size_t len)
+{
+    while (len) {
+        if (ps->seg_used == 0 || ps->seg[ps->seg_used - 1].in_len == PNG_SEGMENT_SIZE) {
+            if (ps->seg_used == ps->threads && png_stream_flush_segments(ps, 0) != 0)
+                return 1;
+            ps->seg_used++;
+        }
 
-    fclose(f);
+        png_segment* sg = &ps->seg[ps->seg_used - 1];
+        size_t n = PNG_SEGMENT_SIZE - sg->in_len;
+        if (n > len)
+            n = len;
+        memcpy(sg->in + sg->in_len, data, n);
+        sg->in_len += n;
+        data += n;
+        len -= n;
+    }
     return 0;
 }
 
-static int write_png_gray8(const char* path, uint32_t w, uint32_t h, const uint8_t* img)
+// Filter one row into a line buffer; returns the line to deflate.
+static const uint8_t* png_stream_filter(png_stream* ps, const uint8_t* cur, const uint8_t* prev)
+{
+    const size_t n = ps->row_bytes;
+
+    if (ps->filter != DDS2PNG_FILTER_ADAPTIVE) {
+        ps->line[0][0] = (uint8_t)ps->filter;
+        png_filter_row(ps->filter, ps->bpp, cur, prev, ps->line[0] + 1, n);
+        return ps->line[0];
+    }
+
+    // Try every filter, keep the one with the smallest sum of |signed byte|.
+    uint8_t* best = ps->line[0];
+    uint8_t* trial = ps->line[1];
+    uint64_t best_cost = UINT64_MAX;
+
+    for (int type = DDS2PNG_FILTER_NONE; type <= DDS2PNG_FILTER_PAETH; ++type) {
+        trial[0] = (uint8_t)type;
+        png_filter_row(type, ps->bpp, cur, prev, trial + 1, n);
+        uint64_t cost = png_row_cost(trial + 1, n);
+        if (cost < best_cost) {
+            uint8_t* t = best;
+            best = trial;
+            trial = t;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+// Hand filtered bytes to the serial deflate stream or the parallel segments.
+static int png_stream_feed(png_stream* ps, const uint8_t* data, size_t len)
 {
-    return write_png_core(path, w, h, img, 0, 1);
+    if (ps->threads > 1)
+        return png_stream_queue(ps, data, len);
+
+    ps->zs->next_in  = (Bytef*)data;
+    ps->zs->avail_in = (uInt)len;
+    return png_stream_deflate(ps, Z_NO_FLUSH);
 }
 
-static int write_png_rgb8(const char* path, uint32_t w, uint32_t h, const uint8_t* img)
+// Append `count` scanlines in PNG layout, `stride` bytes apart: byte 0 of
+// each row is left for the filter type and width * bpp pixel bytes follow.
+// Unfiltered rows are deflated straight out of `rows` (the filter bytes are
+// filled in here); the other filters go through the line buffers.
+static int png_stream_write_rows(png_stream* ps, uint8_t* rows, size_t stride, uint32_t count)
 {
-    return write_png_core(path, w, h, img, 2, 3);
+    if (ps->filter == DDS2PNG_FILTER_NONE) {
+        for (uint32_t y = 0; y < count; ++y)
+            rows[(size_t)y * stride] = DDS2PNG_FILTER_NONE;
+
+        if (stride == ps->row_bytes + 1) {
+            if (count && png_stream_feed(ps, rows, stride * count) != 0)
+                return 1;
+        } else {
+            for (uint32_t y = 0; y < count; ++y)
+                if (png_stream_feed(ps, rows + (size_t)y * stride, ps->row_bytes + 1) != 0)
+                    return 1;
+        }
+    } else {
+        for (uint32_t y = 0; y < count; ++y) {
+            const uint8_t* cur  = rows + (size_t)y * stride + 1;
+            const uint8_t* prev = (y == 0) ? ps->prev : cur - stride;
+            const uint8_t* line = png_stream_filter(ps, cur, prev);
+            if (png_stream_feed(ps, line, ps->row_bytes + 1) != 0)
+                return 1;
+        }
+    }
+
+    if (count)
+        memcpy(ps->prev, rows + (size_t)(count - 1) * stride + 1, ps->row_bytes);
+    ps->rows_done += count;
+    return 0;
 }
 
-static int write_png_rgba8(const char* path, uint32_t w, uint32_t h, const uint8_t* img)
+// Flush the deflate stream, write IEND and close the file.
+static int png_stream_finish(png_stream* ps)
 {
-    return write_png_core(path, w, h, img, 6, 4);
+    if (ps->rows_done != ps->height) {
+        fprintf(stderr, "ERROR: PNG stream got %u of %u rows\n", ps->rows_done, ps->height);
+        png_stream_abort(ps);
+        return 1;
+    }
+
+    int err;
+    if (ps->threads > 1) {
+        err = png_stream_flush_segments(ps, 1);
+    } else {
+        ps->zs->next_in  = Z_NULL;
+        ps->zs->avail_in = 0;
+        err = png_stream_deflate(ps, Z_FINISH);
+    }
+    if (err) {
+        png_stream_abort(ps);
+        return 1;
+    }
+    png_stream_release(ps);
+
+    png_write_chunk(ps, "IEND", NULL, 0);
+
+    if (ps->write_failed) {
+        fprintf(stderr, "ERROR: PNG output callback failed\n");
+        return 1;
+    }
+    if (!ps->f)
+        return 0;
+
+    err = ferror(ps->f);
+    if (fclose(ps->f) != 0)
+        err = 1;
+    ps->f = NULL;
+    if (err) {
+        fprintf(stderr, "ERROR: Failed writing '%s'\n", ps->path);
+        remove(ps->path);
+        return 1;
+    }
+    return 0;
 }
 
 // ----------------------- BC4 Block Decode (also used for BC3 alpha) -----------------------
 
-static void decode_bc4_block(const uint8_t block[8], uint8_t out[16])
+// The 8 values a BC4 block's 3-bit indices select.
+static void bc4_palette(const uint8_t block[8], uint8_t pal[8])
 {
     uint8_t r0 = block[0];
     uint8_t r1 = block[1];
 
-    uint8_t pal[8];
     pal[0] = r0;
     pal[1] = r1;
 
@@ -250,6 +1069,15 @@ static void decode_bc4_block(const uint8_t block[8], uint8_t out[16])
         pal[6] = 0;
         pal[7] = 255;
     }
+}
+
+// Scalar decoders. With SSE2 the vector kernels below replace them (and are
+// bit-exact with them).
+#ifndef DDS2PNG_USE_SSE2
+static void decode_bc4_block(const uint8_t block[8], uint8_t out[16])
+{
+    uint8_t pal[8];
+    bc4_palette(block, pal);
 
     uint64_t bits = 0;
     for (int i = 0; i < 6; ++i) {
@@ -260,6 +1088,69 @@ static void decode_bc4_block(const uint8_t block[8], uint8_t out[16])
         out[i] = pal[(bits >> (3 * i)) & 7u];
     }
 }
+#endif
+
+// Decode `count` BC4 blocks found `block_stride` bytes apart into 16 bytes
+// each (4x4, row-major) at out. Same output as decode_bc4_block().
+//
+// The SSE2 path skips the palette: all 16 indices are spread to bytes with
+// three SWAR steps per 8 pixels, each pixel's interpolation weight comes
+// from its index, and the value is (w0*r0 + w1*r1 + round) / 7 (or / 5)
+// done as a 16-bit mulhi by 9363 (or 13108), exact for every (r0, r1).
+static void decode_bc4_blocks(const uint8_t* blocks, size_t block_stride, uint32_t count, uint8_t* out)
+{
+#ifdef DDS2PNG_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+
+    for (uint32_t k = 0; k < count; ++k) {
+        const uint8_t* block = blocks + (size_t)k * block_stride;
+        const uint8_t r0 = block[0];
+        const uint8_t r1 = block[1];
+        const int five = (r0 <= r1); // 6-value mode: indices 6 and 7 are 0 and 255
+
+        uint64_t bits;
+        memcpy(&bits, block, 8); // x86 is little-endian
+        bits >>= 16;
+
+        // 8 x 3-bit indices -> 8 bytes
+        uint64_t lo = bits & 0xFFFFFFu, hi = bits >> 24;
+        lo = (lo & 0xFFFu) | ((lo & 0xFFF000u) << 20);
+        hi = (hi & 0xFFFu) | ((hi & 0xFFF000u) << 20);
+        lo = (lo & 0x0000003F0000003Full) | ((lo & 0x00000FC000000FC0ull) << 10);
+        hi = (hi & 0x0000003F0000003Full) | ((hi & 0x00000FC000000FC0ull) << 10);
+        lo = (lo & 0x0007000700070007ull) | ((lo & 0x0038003800380038ull) << 5);
+        hi = (hi & 0x0007000700070007ull) | ((hi & 0x0038003800380038ull) << 5);
+        const __m128i idx = _mm_set_epi64x((long long)hi, (long long)lo);
+
+        // Weight of r1: 0 for index 0, W for index 1, index - 1 otherwise
+        const __m128i wmax = _mm_set1_epi8(five ? 5 : 7);
+        __m128i w1 = _mm_or_si128(_mm_subs_epu8(idx, one), _mm_and_si128(_mm_cmpeq_epi8(idx, one), wmax));
+        w1 = _mm_min_epu8(w1, wmax);
+        __m128i w0 = _mm_sub_epi8(wmax, w1);
+
+        const __m128i v0 = _mm_set1_epi16(r0);
+        const __m128i v1 = _mm_set1_epi16(r1);
+        const __m128i rnd = _mm_set1_epi16(five ? 2 : 3);
+        const __m128i mul = _mm_set1_epi16((short)(five ? 13108 : 9363));
+        __m128i a = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(w0, zero), v0),
+                                                _mm_mullo_epi16(_mm_unpacklo_epi8(w1, zero), v1)), rnd);
+        __m128i b = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(w0, zero), v0),
+                                                _mm_mullo_epi16(_mm_unpackhi_epi8(w1, zero), v1)), rnd);
+        __m128i px = _mm_packus_epi16(_mm_mulhi_epu16(a, mul), _mm_mulhi_epu16(b, mul));
+
+        if (five) {
+            __m128i hi67 = _mm_cmpgt_epi8(idx, _mm_set1_epi8(5));
+            __m128i is7 = _mm_cmpeq_epi8(idx, _mm_set1_epi8(7));
+            px = _mm_or_si128(_mm_andnot_si128(hi67, px), is7);
+        }
+        _mm_storeu_si128((__m128i*)(out + (size_t)k * 16u), px);
+    }
+#else
+    for (uint32_t k = 0; k < count; ++k)
+        decode_bc4_block(blocks + (size_t)k * block_stride, out + (size_t)k * 16u);
+#endif
+}
 
 // ----------------------- BC1 / BC2 / BC3 Decoding -----------------------
 
@@ -275,8 +1166,8 @@ static void rgb565_to_rgb888(uint16_t c, uint8_t* r, uint8_t* g, uint8_t* b)
     *b = (uint8_t)((b5 * 255 + 15) / 31);
 }
 
-// Decode a BC1 (DXT1) block into 16 RGBA pixels.
-static void decode_bc1_block(const uint8_t block[8], uint8_t out_rgba[16 * 4])
+// The 4 RGBA colors a BC1 block's 2-bit indices select.
+static void bc1_palette(const uint8_t block[8], uint8_t c[4][4])
 {
     uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
     uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
@@ -286,7 +1177,6 @@ static void decode_bc1_block(const uint8_t block[8], uint8_t out_rgba[16 * 4])
     rgb565_to_rgb888(c0, &r0, &g0, &b0);
     rgb565_to_rgb888(c1, &r1, &g1, &b1);
 
-    uint8_t c[4][4]; // [color_index][rgba]
     c[0][0] = r0; c[0][1] = g0; c[0][2] = b0; c[0][3] = 255;
     c[1][0] = r1; c[1][1] = g1; c[1][2] = b1; c[1][3] = 255;
 
@@ -313,6 +1203,15 @@ static void decode_bc1_block(const uint8_t block[8], uint8_t out_rgba[16 * 4])
         c[3][2] = 0;
         c[3][3] = 0; // transparent
     }
+}
+
+#ifndef DDS2PNG_USE_SSE2
+
+// Decode a BC1 (DXT1) block into 16 RGBA pixels.
+static void decode_bc1_block(const uint8_t block[8], uint8_t out_rgba[16 * 4])
+{
+    uint8_t c[4][4]; // [color_index][rgba]
+    bc1_palette(block, c);
 
     uint32_t indices = (uint32_t)(block[4] | (block[5] << 8) | (block[6] << 16) | (block[7] << 24));
 
@@ -324,6 +1223,7 @@ static void decode_bc1_block(const uint8_t block[8], uint8_t out_rgba[16 * 4])
         out_rgba[i*4 + 3] = c[idx][3];
     }
 }
+#endif
 
 // Decode BC2 (DXT3) alpha (explicit 4-bit alpha).
 static void decode_bc2_alpha(const uint8_t alphaBlock[8], uint8_t out_alpha[16])
@@ -339,414 +1239,1762 @@ static void decode_bc2_alpha(const uint8_t alphaBlock[8], uint8_t out_alpha[16])
     }
 }
 
-// ----------------------- Main Conversion Function -----------------------
+// ----------------------- SIMD BC1 Decoding -----------------------
+//
+// Decodes four BC1 color blocks per call straight into the destination rows,
+// bit-exact with decode_bc1_block(). The 5:6:5 expansion uses multiply-shift
+// forms of the scalar rounding divides ((v*527+23)>>6 for 5 bits,
+// (v*259+33)>>6 for 6 bits) and /3 is a mulhi by 0xAAAB, exact for the
+// 0..765 range the interpolants can reach. The four palettes are built side
+// by side in 16-bit lanes, transposed to one 4x32-bit palette per block, and
+// the 2-bit indices select entries per row (SSE2 compare/mask, or one vpermd
+// per two rows with AVX2).
+
+#if defined(__AVX2__)
+#define DDS2PNG_USE_AVX2
+#include <immintrin.h>
+#endif
 
-#ifdef __cplusplus
-extern "C" {
-    #endif
+#ifdef DDS2PNG_USE_SSE2
+// Decode `count` (1..4) BC1 color blocks found `block_stride` bytes apart
+// into 4x4 RGBA pixels at dst (rows `dst_stride` bytes apart).
+static void decode_bc1_blocks_x4(const uint8_t* blocks, size_t block_stride, uint32_t count,
+                                 uint8_t* dst, size_t dst_stride)
+{
+    uint32_t ep[4] = { 0, 0, 0, 0 };  // c0 | c1 << 16
+    uint32_t sel[4] = { 0, 0, 0, 0 }; // 2-bit indices
+    for (uint32_t k = 0; k < count; ++k) {
+        memcpy(&ep[k],  blocks + k * block_stride,     4);
+        memcpy(&sel[k], blocks + k * block_stride + 4, 4);
+    }
 
-    int dds2png_convert(const char* input, const char* output)
-    {
-        FILE* f = fopen(input, "rb");
-        if (!f) {
-            fprintf(stderr, "ERROR: cannot open '%s'\n", input);
-            return 1;
+    // 16-bit lanes 0-3: c0 of blocks 0-3, lanes 4-7: c1 of blocks 0-3
+    const __m128i raw = _mm_setr_epi32((int)ep[0], (int)ep[1], (int)ep[2], (int)ep[3]);
+    const __m128i lo16 = _mm_srai_epi32(_mm_slli_epi32(raw, 16), 16);
+    const __m128i hi16 = _mm_srai_epi32(raw, 16);
+    const __m128i c = _mm_packs_epi32(lo16, hi16);
+
+    const __m128i m5 = _mm_set1_epi16(0x1F);
+    __m128i r = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(c, 11), _mm_set1_epi16(527)), _mm_set1_epi16(23)), 6);
+    __m128i g = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(c, 5), _mm_set1_epi16(0x3F)), _mm_set1_epi16(259)), _mm_set1_epi16(33)), 6);
+    __m128i b = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(c, m5), _mm_set1_epi16(527)), _mm_set1_epi16(23)), 6);
+
+    // Four-color blocks: c0 > c1 (unsigned), replicated to the c1 lanes
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    __m128i cx = _mm_xor_si128(c, bias);
+    __m128i four = _mm_cmpgt_epi16(cx, _mm_shuffle_epi32(cx, 0x4E));
+    four = _mm_unpacklo_epi64(four, four);
+
+    // Lanes 0-3 -> color 2, lanes 4-7 -> color 3
+    const __m128i third = _mm_set1_epi16((short)0xAAAB);
+    __m128i r_sw = _mm_shuffle_epi32(r, 0x4E), g_sw = _mm_shuffle_epi32(g, 0x4E), b_sw = _mm_shuffle_epi32(b, 0x4E);
+    __m128i r4 = _mm_srli_epi16(_mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16(r, r), r_sw), third), 1);
+    __m128i g4 = _mm_srli_epi16(_mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16(g, g), g_sw), third), 1);
+    __m128i b4 = _mm_srli_epi16(_mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16(b, b), b_sw), third), 1);
+    const __m128i lo_half = _mm_setr_epi16(-1, -1, -1, -1, 0, 0, 0, 0);
+    __m128i r3 = _mm_and_si128(_mm_srli_epi16(_mm_add_epi16(r, r_sw), 1), lo_half);
+    __m128i g3 = _mm_and_si128(_mm_srli_epi16(_mm_add_epi16(g, g_sw), 1), lo_half);
+    __m128i b3 = _mm_and_si128(_mm_srli_epi16(_mm_add_epi16(b, b_sw), 1), lo_half);
+    __m128i r23 = _mm_or_si128(_mm_and_si128(four, r4), _mm_andnot_si128(four, r3));
+    __m128i g23 = _mm_or_si128(_mm_and_si128(four, g4), _mm_andnot_si128(four, g3));
+    __m128i b23 = _mm_or_si128(_mm_and_si128(four, b4), _mm_andnot_si128(four, b3));
+    __m128i a23 = _mm_or_si128(four, lo_half); // color 3 is transparent in 3-color blocks
+
+    // Pack to 32-bit RGBA: pal01 lanes = c0[0..3] / c1[0..3], pal23 = c2 / c3
+    const __m128i alpha = _mm_set1_epi16((short)0xFF00);
+    __m128i rg01 = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    __m128i ba01 = _mm_or_si128(b, alpha);
+    __m128i rg23 = _mm_or_si128(r23, _mm_slli_epi16(g23, 8));
+    __m128i ba23 = _mm_or_si128(b23, _mm_slli_epi16(a23, 8));
+    __m128i p0 = _mm_unpacklo_epi16(rg01, ba01);
+    __m128i p1 = _mm_unpackhi_epi16(rg01, ba01);
+    __m128i p2 = _mm_unpacklo_epi16(rg23, ba23);
+    __m128i p3 = _mm_unpackhi_epi16(rg23, ba23);
+
+    // Transpose to one palette (entries 0-3) per block
+    __m128i t0 = _mm_unpacklo_epi32(p0, p1), t1 = _mm_unpacklo_epi32(p2, p3);
+    __m128i t2 = _mm_unpackhi_epi32(p0, p1), t3 = _mm_unpackhi_epi32(p2, p3);
+    __m128i pal[4];
+    pal[0] = _mm_unpacklo_epi64(t0, t1);
+    pal[1] = _mm_unpackhi_epi64(t0, t1);
+    pal[2] = _mm_unpacklo_epi64(t2, t3);
+    pal[3] = _mm_unpackhi_epi64(t2, t3);
+
+    for (uint32_t k = 0; k < count; ++k) {
+        uint8_t* out = dst + (size_t)k * 16u;
+#ifdef DDS2PNG_USE_AVX2
+        // 8 pixels per permute: lane i picks entry (sel >> 2i) & 7, and bit 2
+        // lands in the upper copy of the palette, so no mask is needed
+        const __m256i pal8 = _mm256_broadcastsi128_si256(pal[k]);
+        const __m256i shifts = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+        const __m256i idx = _mm256_set1_epi32((int)sel[k]);
+        __m256i rows01 = _mm256_permutevar8x32_epi32(pal8, _mm256_srlv_epi32(idx, shifts));
+        __m256i rows23 = _mm256_permutevar8x32_epi32(pal8, _mm256_srlv_epi32(_mm256_srli_epi32(idx, 16), shifts));
+        _mm_storeu_si128((__m128i*)(out),                  _mm256_castsi256_si128(rows01));
+        _mm_storeu_si128((__m128i*)(out + dst_stride),     _mm256_extracti128_si256(rows01, 1));
+        _mm_storeu_si128((__m128i*)(out + 2 * dst_stride), _mm256_castsi256_si128(rows23));
+        _mm_storeu_si128((__m128i*)(out + 3 * dst_stride), _mm256_extracti128_si256(rows23, 1));
+#else
+        const __m128i e0 = _mm_shuffle_epi32(pal[k], 0x00);
+        const __m128i e1 = _mm_shuffle_epi32(pal[k], 0x55);
+        const __m128i e2 = _mm_shuffle_epi32(pal[k], 0xAA);
+        const __m128i e3 = _mm_shuffle_epi32(pal[k], 0xFF);
+        const __m128i mask = _mm_setr_epi32(0x03, 0x0C, 0x30, 0xC0);
+        const __m128i one  = _mm_setr_epi32(0x01, 0x04, 0x10, 0x40);
+        const __m128i two  = _mm_setr_epi32(0x02, 0x08, 0x20, 0x80);
+        for (uint32_t py = 0; py < 4; ++py) {
+            // Each lane keeps its pixel's 2 index bits in place
+            __m128i v = _mm_and_si128(_mm_set1_epi32((int)((sel[k] >> (8 * py)) & 0xFFu)), mask);
+            __m128i px = _mm_and_si128(_mm_cmpeq_epi32(v, _mm_setzero_si128()), e0);
+            px = _mm_or_si128(px, _mm_and_si128(_mm_cmpeq_epi32(v, one), e1));
+            px = _mm_or_si128(px, _mm_and_si128(_mm_cmpeq_epi32(v, two), e2));
+            px = _mm_or_si128(px, _mm_and_si128(_mm_cmpeq_epi32(v, mask), e3));
+            _mm_storeu_si128((__m128i*)(out + py * dst_stride), px);
         }
+#endif
+    }
+}
+#endif
 
-        // Check magic
-        uint32_t magic = 0;
-        if (fread(&magic, 1, 4, f) != 4 || magic != DDS_MAGIC) {
-            fclose(f);
-            return 1;
+// ----------------------- Uniform Blocks -----------------------
+//
+// A block whose 16 pixels all decode to one value (solid masks, empty atlas
+// space, fully transparent regions) is splat-filled instead of decoded. The
+// tests are cheap and exact: every index the same, or both endpoints equal
+// with no index that selects a fixed entry. The value is the palette entry
+// the scalar decoders would pick, computed alone.
+
+// BC1 color: 4 RGBA bytes at px, alpha 0 only for the transparent entry.
+static int bc1_block_uniform(const uint8_t block[8], uint8_t px[4])
+{
+    const uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+    const uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+    const uint32_t sel = (uint32_t)block[4] | ((uint32_t)block[5] << 8) |
+                         ((uint32_t)block[6] << 16) | ((uint32_t)block[7] << 24);
+
+    uint32_t idx;
+    if (sel == (sel & 3u) * 0x55555555u)
+        idx = sel & 3u;
+    else if (c0 == c1 && (sel & (sel >> 1) & 0x55555555u) == 0)
+        idx = 0; // 3-color mode: entries 0-2 are c0, no pixel uses entry 3
+    else
+        return 0;
+
+    uint8_t pal[4][4];
+    bc1_palette(block, pal);
+    memcpy(px, pal[idx], 4);
+    return 1;
+}
+
+// BC4 channel (BC3 alpha, BC5 X/Y): one byte at v.
+static int bc4_block_uniform(const uint8_t block[8], uint8_t* v)
+{
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i)
+        bits |= ((uint64_t)block[2 + i]) << (8 * i);
+
+    const uint32_t idx = (uint32_t)(bits & 7u);
+    if (bits != idx * 0x249249249249ull) {
+        // r0 == r1 is the 6-value mode with entries 0-5 all r0; entries 6
+        // and 7 (indices with both high bits set) are 0 and 255
+        if (block[0] != block[1] || (bits & (bits >> 1) & 0x492492492492ull) != 0)
+            return 0;
+        *v = block[0];
+        return 1;
+    }
+
+    uint8_t pal[8];
+    bc4_palette(block, pal);
+    *v = pal[idx];
+    return 1;
+}
+
+// BC2 explicit alpha: one byte at v.
+static int bc2_alpha_uniform(const uint8_t block[8], uint8_t* v)
+{
+    const uint8_t b = block[0];
+    if ((b >> 4) != (b & 0xF))
+        return 0;
+    for (int i = 1; i < 8; ++i) {
+        if (block[i] != b)
+            return 0;
+    }
+    *v = (uint8_t)((b & 0xF) * 17);
+    return 1;
+}
+
+// ----------------------- Block Averages -----------------------
+//
+// Preview decoding (see dds_image::preview) turns each 4x4 block into one
+// pixel, the rounded mean of its 16 texels. The mean comes from the palette
+// and a histogram of the indices, without writing the texels out, and is
+// exactly what box-filtering the full decode would give. Blocks cut by the
+// right or bottom edge are decoded and averaged over their texels inside the
+// image (see mean_row_with).
+
+static uint32_t dds_popcount32(uint32_t v)
+{
+    v = v - ((v >> 1) & 0x55555555u);
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+    v = (v + (v >> 4)) & 0x0F0F0F0Fu;
+    return (v * 0x01010101u) >> 24;
+}
+
+// BC1 color: RGBA at px.
+static void bc1_block_mean(const uint8_t block[8], uint8_t px[4])
+{
+    uint8_t pal[4][4];
+    bc1_palette(block, pal);
+
+    // Index counts: bit 0 and bit 1 of every 2-bit index, side by side
+    const uint32_t sel = (uint32_t)block[4] | ((uint32_t)block[5] << 8) |
+                         ((uint32_t)block[6] << 16) | ((uint32_t)block[7] << 24);
+    const uint32_t lo = sel & 0x55555555u, hi = (sel >> 1) & 0x55555555u;
+    const uint32_t n3 = dds_popcount32(lo & hi);
+    const uint32_t n1 = dds_popcount32(lo) - n3;
+    const uint32_t n2 = dds_popcount32(hi) - n3;
+    const uint32_t n0 = 16 - n1 - n2 - n3;
+
+    for (int c = 0; c < 4; ++c)
+        px[c] = (uint8_t)((n0 * pal[0][c] + n1 * pal[1][c] + n2 * pal[2][c] + n3 * pal[3][c] + 8) >> 4);
+}
+
+// BC4 channel: one byte.
+static uint8_t bc4_block_mean(const uint8_t block[8])
+{
+    uint8_t pal[8];
+    bc4_palette(block, pal);
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i)
+        bits |= ((uint64_t)block[2 + i]) << (8 * i);
+
+    uint32_t sum = 8;
+    for (int i = 0; i < 16; ++i)
+        sum += pal[(bits >> (3 * i)) & 7u];
+    return (uint8_t)(sum >> 4);
+}
+
+// BC2 explicit alpha: one byte.
+static uint8_t bc2_alpha_mean(const uint8_t block[8])
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < 8; ++i)
+        sum += (uint32_t)(block[i] & 0xF) + (uint32_t)(block[i] >> 4);
+    return (uint8_t)((sum * 17 + 8) >> 4);
+}
+
+// ----------------------- Block Row Decoding -----------------------
+
+typedef struct {
+    uint32_t dxgi;
+    uint32_t block_bytes;
+    uint8_t color_type; // PNG color type: 0 = gray, 2 = RGB, 4 = gray+alpha, 6 = RGBA
+    uint8_t bpp;        // output bytes per pixel
+    uint16_t decode_mpps; // rough single-core decode rate in Mpixels/s (cost estimates only)
+} dds_format_info;
+
+static const dds_format_info g_dds_formats[] = {
+    { DXGI_FORMAT_BC1_UNORM,  8, 6, 4, 300 },
+    { DXGI_FORMAT_BC2_UNORM, 16, 6, 4, 250 },
+    { DXGI_FORMAT_BC3_UNORM, 16, 6, 4, 250 },
+    { DXGI_FORMAT_BC4_UNORM,  8, 0, 1, 800 },
+    { DXGI_FORMAT_BC5_UNORM, 16, 2, 3, 250 },
+    { DXGI_FORMAT_BC7_UNORM, 16, 6, 4, 120 },
+};
+
+static const dds_format_info* dds_find_format(uint32_t dxgi)
+{
+    for (size_t i = 0; i < sizeof(g_dds_formats) / sizeof(g_dds_formats[0]); ++i) {
+        if (g_dds_formats[i].dxgi == dxgi)
+            return &g_dds_formats[i];
+    }
+    return NULL;
+}
+
+// PNG layout a source format is written as: BC5 as X/Y only is gray+alpha,
+// with Z left to the consumer.
+static dds_format_info dds_output_format(const dds_format_info* fi, const dds2png_options* opts)
+{
+    dds_format_info out = *fi;
+    if (fi->dxgi == DXGI_FORMAT_BC5_UNORM && opts->bc5_output == DDS2PNG_BC5_XY) {
+        out.color_type = 4;
+        out.bpp = 2;
+    }
+    return out;
+}
+
+// BC5 normal Z for every (X, Y) byte pair, same arithmetic as rebuilding it
+// per pixel: X and Y map to [-1, 1], Z = sqrt(max(0, 1 - x^2 - y^2)).
+static uint8_t g_bc5_z[256 * 256];
+static pthread_once_t g_bc5_z_once = PTHREAD_ONCE_INIT;
+
+static void bc5_z_table_init(void)
+{
+    for (int r = 0; r < 256; ++r) {
+        double nx = (double)r / 255.0 * 2.0 - 1.0;
+        for (int g = 0; g < 256; ++g) {
+            double ny = (double)g / 255.0 * 2.0 - 1.0;
+            double nz2 = 1.0 - nx*nx - ny*ny;
+            double nz  = (nz2 > 0.0) ? sqrt(nz2) : 0.0;
+            g_bc5_z[r << 8 | g] = (uint8_t)((nz * 0.5 + 0.5) * 255.0 + 0.5);
         }
+    }
+}
 
-        // Read DDS header
-        DDS_HEADER hdr;
-        if (fread(&hdr, sizeof(hdr), 1, f) != 1) {
-            fclose(f);
-            return 1;
+static const uint8_t* bc5_z_table(void)
+{
+    pthread_once(&g_bc5_z_once, bc5_z_table_init);
+    return g_bc5_z;
+}
+
+#define BC4_CHUNK 16 // BC4 channels are decoded this many blocks at a time
+
+// Strip kernels: decode `count` consecutive blocks into 4 scanlines, block i
+// at dst + i * 4 * bpp, with `stride` bytes between scanlines. All four
+// rows and all 4 * count columns are written.
+typedef void (*dds_strip_fn)(const uint8_t* blocks, uint32_t count, uint8_t* dst, size_t stride);
+
+static void bc_store_block(uint8_t* dst, size_t stride, const uint8_t* px, uint32_t row_bytes)
+{
+    for (uint32_t py = 0; py < 4; ++py)
+        memcpy(dst + py * stride, px + py * row_bytes, row_bytes);
+}
+
+// Overwrite the alpha bytes of a 4x4 RGBA block already written at dst.
+static void bc_store_alpha(uint8_t* dst, size_t stride, const uint8_t alpha[16])
+{
+    for (uint32_t py = 0; py < 4; ++py) {
+        uint8_t* row = dst + py * stride;
+        row[3]  = alpha[py * 4 + 0];
+        row[7]  = alpha[py * 4 + 1];
+        row[11] = alpha[py * 4 + 2];
+        row[15] = alpha[py * 4 + 3];
+    }
+}
+
+// BC1 color of BC1/BC2/BC3 blocks, `block_bytes` apart
+static void bc1_color_strip(const uint8_t* color, uint32_t block_bytes, uint32_t count, uint8_t* dst, size_t stride)
+{
+#ifdef DDS2PNG_USE_SSE2
+    for (uint32_t i = 0; i < count; i += 4) {
+        uint32_t n = (count - i < 4) ? count - i : 4;
+        decode_bc1_blocks_x4(color + (size_t)i * block_bytes, block_bytes, n, dst + (size_t)i * 16u, stride);
+    }
+#else
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t rgba[16 * 4];
+        decode_bc1_block(color + (size_t)i * block_bytes, rgba);
+        bc_store_block(dst + (size_t)i * 16u, stride, rgba, 16u);
+    }
+#endif
+}
+
+static void bc1_strip(const uint8_t* blocks, uint32_t count, uint8_t* dst, size_t stride)
+{
+    bc1_color_strip(blocks, 8u, count, dst, stride);
+}
+
+// BC2: 8 bytes explicit alpha, then BC1 color
+static void bc2_strip(const uint8_t* blocks, uint32_t count, uint8_t* dst, size_t stride)
+{
+    bc1_color_strip(blocks + 8, 16u, count, dst, stride);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t alpha[16];
+        decode_bc2_alpha(blocks + (size_t)i * 16u, alpha);
+        bc_store_alpha(dst + (size_t)i * 16u, stride, alpha);
+    }
+}
+
+// BC3: 8 bytes BC4-style alpha, then BC1 color
+static void bc3_strip(const uint8_t* blocks, uint32_t count, uint8_t* dst, size_t stride)
+{
+    bc1_color_strip(blocks + 8, 16u, count, dst, stride);
+    for (uint32_t i = 0; i < count; i += BC4_CHUNK) {
+        uint32_t n = (count - i < BC4_CHUNK) ? count - i : BC4_CHUNK;
+        uint8_t alpha[BC4_CHUNK * 16];
+        decode_bc4_blocks(blocks + (size_t)i * 16u, 16u, n, alpha);
+        for (uint32_t k = 0; k < n; ++k)
+            bc_store_alpha(dst + (size_t)(i + k) * 16u, stride, alpha + k * 16u);
+    }
+}
+
+static void bc4_strip(const uint8_t* blocks, uint32_t count, uint8_t* dst, size_t stride)
+{
+    for (uint32_t i = 0; i < count; i += BC4_CHUNK) {
+        uint32_t n = (count - i < BC4_CHUNK) ? count - i : BC4_CHUNK;
+        uint8_t px[BC4_CHUNK * 16];
+        decode_bc4_blocks(blocks + (size_t)i * 8u, 8u, n, px);
+        for (uint32_t k = 0; k < n; ++k)
+            bc_store_block(dst + (size_t)(i + k) * 4u, stride, px + k * 16u, 4u);
+    }
+}
+
+// BC5: two BC4 channels; bpp 3 adds Z from the table, bpp 2 keeps X/Y
+static inline void bc5_strip(const uint8_t* blocks, uint32_t count, uint8_t* dst, size_t stride, uint32_t bpp)
+{
+    const uint8_t* z_table = (bpp == 3) ? bc5_z_table() : NULL;
+
+    for (uint32_t i = 0; i < count; i += BC4_CHUNK) {
+        uint32_t n = (count - i < BC4_CHUNK) ? count - i : BC4_CHUNK;
+        uint8_t rx[BC4_CHUNK * 16];
+        uint8_t gy[BC4_CHUNK * 16];
+        decode_bc4_blocks(blocks + (size_t)i * 16u,      16u, n, rx);
+        decode_bc4_blocks(blocks + (size_t)i * 16u + 8u, 16u, n, gy);
+
+        for (uint32_t k = 0; k < n; ++k) {
+            for (uint32_t py = 0; py < 4; ++py) {
+                uint8_t* row = dst + py * stride + (size_t)(i + k) * 4u * bpp;
+                for (uint32_t px = 0; px < 4; ++px) {
+                    // X and Y round-trip through the normal unchanged
+                    const uint8_t r = rx[k * 16 + py * 4 + px];
+                    const uint8_t g = gy[k * 16 + py * 4 + px];
+                    row[px * bpp + 0] = r;
+                    row[px * bpp + 1] = g;
+                    if (bpp == 3)
+                        row[px * bpp + 2] = z_table[(size_t)r << 8 | g];
+                }
+            }
         }
+    }
+}
 
-        // We only support DX10 extended header
-        if (hdr.ddspf.dwFourCC != DDS_FOURCC('D','X','1','0')) {
-            fprintf(stderr, "ERROR: non-DX10 DDS unsupported: %s\n", input);
-            fclose(f);
-            return 1;
+static void bc5_rgb_strip(const uint8_t* blocks, uint32_t count, uint8_t* dst, size_t stride)
+{
+    bc5_strip(blocks, count, dst, stride, 3);
+}
+
+static void bc5_xy_strip(const uint8_t* blocks, uint32_t count, uint8_t* dst, size_t stride)
+{
+    bc5_strip(blocks, count, dst, stride, 2);
+}
+
+static void bc7_strip(const uint8_t* blocks, uint32_t count, uint8_t* dst, size_t stride)
+{
+    bc7_decode_blocks(blocks, count, dst, (size_t)stride);
+}
+
+// Uniform tests per format: the one output pixel (bpp bytes) at px.
+typedef int (*dds_uniform_fn)(const uint8_t* block, uint8_t* px);
+
+static int bc1_uniform(const uint8_t* block, uint8_t* px)
+{
+    return bc1_block_uniform(block, px);
+}
+
+static int bc2_uniform(const uint8_t* block, uint8_t* px)
+{
+    uint8_t a;
+    if (!bc2_alpha_uniform(block, &a) || !bc1_block_uniform(block + 8, px))
+        return 0;
+    px[3] = a;
+    return 1;
+}
+
+static int bc3_uniform(const uint8_t* block, uint8_t* px)
+{
+    uint8_t a;
+    if (!bc4_block_uniform(block, &a) || !bc1_block_uniform(block + 8, px))
+        return 0;
+    px[3] = a;
+    return 1;
+}
+
+static int bc4_uniform(const uint8_t* block, uint8_t* px)
+{
+    return bc4_block_uniform(block, px);
+}
+
+static int bc5_xy_uniform(const uint8_t* block, uint8_t* px)
+{
+    return bc4_block_uniform(block, px) && bc4_block_uniform(block + 8, px + 1);
+}
+
+static int bc5_rgb_uniform(const uint8_t* block, uint8_t* px)
+{
+    if (!bc5_xy_uniform(block, px))
+        return 0;
+    px[2] = bc5_z_table()[(size_t)px[0] << 8 | px[1]];
+    return 1;
+}
+
+static int bc7_uniform(const uint8_t* block, uint8_t* px)
+{
+    return bc7_block_uniform(block, px);
+}
+
+// Fast-path counters per g_dds_formats entry, summed over all conversions
+// (see dds2png_get_block_stats).
+enum { DDS_STAT_BLOCKS, DDS_STAT_UNIFORM, DDS_STAT_REPEATED, DDS_STAT_COUNT };
+static uint64_t g_block_stats[sizeof(g_dds_formats) / sizeof(g_dds_formats[0])][DDS_STAT_COUNT];
+
+static void bc_splat_block(uint8_t* dst, size_t stride, const uint8_t* px, uint32_t bpp)
+{
+    uint8_t row[16];
+    for (uint32_t i = 0; i < 4; ++i)
+        memcpy(row + i * bpp, px, bpp);
+    for (uint32_t py = 0; py < 4; ++py)
+        memcpy(dst + py * stride, row, (size_t)4u * bpp);
+}
+
+// The one block row driver, inlined per format with constant block size,
+// bytes per pixel and kernels (the C stand-in for a template over format
+// traits). Interior blocks are decoded straight into the band, runs of
+// ordinary blocks in one strip call each; a block byte-identical to the one
+// before it is copied from that block's pixels, and a uniform block is
+// splat-filled. Only the right edge block and a partial last block row go
+// through a 4x4 scratch block and a clipped copy.
+static inline void decode_row_with(
+    const uint8_t* blocks, uint32_t blocks_x, uint8_t* band, size_t stride, uint32_t w, uint32_t rows,
+    uint32_t block_bytes, uint32_t bpp, dds_strip_fn strip, dds_uniform_fn uniform, uint32_t stat)
+{
+    const uint32_t full_x = (rows == 4) ? w / 4 : 0;
+    const size_t block_px = (size_t)4u * bpp; // bytes of one block scanline
+    uint64_t uniform_n = 0, repeated_n = 0;
+    uint32_t run = 0; // first block of the pending run of ordinary blocks
+
+    for (uint32_t bx = 0; bx < full_x; ++bx) {
+        const uint8_t* block = blocks + (size_t)bx * block_bytes;
+        uint8_t* out = band + (size_t)bx * block_px;
+        uint8_t px[4];
+        const int repeated = bx > 0 && memcmp(block, block - block_bytes, block_bytes) == 0;
+        if (!repeated && !uniform(block, px))
+            continue;
+
+        if (bx > run)
+            strip(blocks + (size_t)run * block_bytes, bx - run, band + (size_t)run * block_px, stride);
+        if (repeated) {
+            for (uint32_t py = 0; py < 4; ++py)
+                memcpy(out + py * stride, out + py * stride - block_px, block_px);
+            repeated_n++;
+        } else {
+            bc_splat_block(out, stride, px, bpp);
+            uniform_n++;
         }
+        run = bx + 1;
+    }
+    if (full_x > run)
+        strip(blocks + (size_t)run * block_bytes, full_x - run, band + (size_t)run * block_px, stride);
 
-        DDS_HEADER_DX10 dx10;
-        if (fread(&dx10, sizeof(dx10), 1, f) != 1) {
-            fclose(f);
-            return 1;
+    for (uint32_t bx = full_x; bx < blocks_x; ++bx) {
+        uint8_t px[16 * 4];
+        strip(blocks + (size_t)bx * block_bytes, 1, px, 4u * bpp);
+
+        const uint32_t cols = (w - bx * 4 < 4) ? w - bx * 4 : 4;
+        for (uint32_t py = 0; py < rows; ++py)
+            memcpy(band + py * stride + (size_t)bx * 4u * bpp, px + py * 4u * bpp, (size_t)cols * bpp);
+    }
+
+    uint64_t* counts = g_block_stats[stat];
+    __atomic_fetch_add(&counts[DDS_STAT_BLOCKS], (uint64_t)blocks_x, __ATOMIC_RELAXED);
+    if (uniform_n)
+        __atomic_fetch_add(&counts[DDS_STAT_UNIFORM], uniform_n, __ATOMIC_RELAXED);
+    if (repeated_n)
+        __atomic_fetch_add(&counts[DDS_STAT_REPEATED], repeated_n, __ATOMIC_RELAXED);
+}
+
+// Decode one row of blocks into `band`: `rows` (1..4) scanlines of w pixels
+// at the format's output bytes per pixel, `stride` bytes apart.
+static void decode_block_row(
+    const dds_format_info* fi,
+    const uint8_t* blocks,
+    uint32_t blocks_x,
+    uint8_t* band,
+    size_t stride,
+    uint32_t w,
+    uint32_t rows
+)
+{
+    // The last argument indexes g_dds_formats
+    switch (fi->dxgi) {
+    case DXGI_FORMAT_BC1_UNORM: decode_row_with(blocks, blocks_x, band, stride, w, rows,  8, 4, bc1_strip, bc1_uniform, 0); break;
+    case DXGI_FORMAT_BC2_UNORM: decode_row_with(blocks, blocks_x, band, stride, w, rows, 16, 4, bc2_strip, bc2_uniform, 1); break;
+    case DXGI_FORMAT_BC3_UNORM: decode_row_with(blocks, blocks_x, band, stride, w, rows, 16, 4, bc3_strip, bc3_uniform, 2); break;
+    case DXGI_FORMAT_BC4_UNORM: decode_row_with(blocks, blocks_x, band, stride, w, rows,  8, 1, bc4_strip, bc4_uniform, 3); break;
+    case DXGI_FORMAT_BC5_UNORM:
+        if (fi->bpp == 2)
+            decode_row_with(blocks, blocks_x, band, stride, w, rows, 16, 2, bc5_xy_strip, bc5_xy_uniform, 4);
+        else
+            decode_row_with(blocks, blocks_x, band, stride, w, rows, 16, 3, bc5_rgb_strip, bc5_rgb_uniform, 4);
+        break;
+    case DXGI_FORMAT_BC7_UNORM: decode_row_with(blocks, blocks_x, band, stride, w, rows, 16, 4, bc7_strip, bc7_uniform, 5); break;
+    default: break;
+    }
+}
+
+// Block means per format: the one output pixel (bpp bytes) at px.
+typedef void (*dds_mean_fn)(const uint8_t* block, uint8_t* px);
+
+static void bc1_mean(const uint8_t* block, uint8_t* px)
+{
+    bc1_block_mean(block, px);
+}
+
+static void bc2_mean(const uint8_t* block, uint8_t* px)
+{
+    bc1_block_mean(block + 8, px);
+    px[3] = bc2_alpha_mean(block);
+}
+
+static void bc3_mean(const uint8_t* block, uint8_t* px)
+{
+    bc1_block_mean(block + 8, px);
+    px[3] = bc4_block_mean(block);
+}
+
+static void bc4_mean(const uint8_t* block, uint8_t* px)
+{
+    px[0] = bc4_block_mean(block);
+}
+
+static void bc5_xy_mean(const uint8_t* block, uint8_t* px)
+{
+    px[0] = bc4_block_mean(block);
+    px[1] = bc4_block_mean(block + 8);
+}
+
+// Z is rebuilt from the mean X/Y, not averaged
+static void bc5_rgb_mean(const uint8_t* block, uint8_t* px)
+{
+    bc5_xy_mean(block, px);
+    px[2] = bc5_z_table()[(size_t)px[0] << 8 | px[1]];
+}
+
+static void bc7_mean(const uint8_t* block, uint8_t* px)
+{
+    bc7_block_mean(block, px);
+}
+
+// Preview row driver, inlined per format like decode_row_with. Whole
+// blocks take the mean kernel; a block cut by the image edge (the last
+// column when w is not a multiple of 4, every block of a partial last row)
+// is decoded with the strip kernel and its `cols` x `rows` texels inside
+// the image are averaged. The strip writes `strip_bpp` channels; BC5 as RGB
+// decodes X/Y only and rebuilds Z from their means, as bc5_rgb_mean does.
+static inline void mean_row_with(
+    const uint8_t* blocks, uint32_t blocks_x, uint8_t* row, uint32_t w, uint32_t rows,
+    uint32_t block_bytes, uint32_t bpp, dds_mean_fn mean, dds_strip_fn strip, uint32_t strip_bpp)
+{
+    const uint32_t full_x = (rows == 4) ? w / 4 : 0;
+
+    for (uint32_t bx = 0; bx < full_x; ++bx)
+        mean(blocks + (size_t)bx * block_bytes, row + (size_t)bx * bpp);
+
+    for (uint32_t bx = full_x; bx < blocks_x; ++bx) {
+        uint8_t px[16 * 4];
+        strip(blocks + (size_t)bx * block_bytes, 1, px, 4u * strip_bpp);
+
+        const uint32_t cols = (w - bx * 4 < 4) ? w - bx * 4 : 4;
+        const uint32_t n = cols * rows;
+        uint8_t* out = row + (size_t)bx * bpp;
+        for (uint32_t c = 0; c < strip_bpp; ++c) {
+            uint32_t sum = n / 2;
+            for (uint32_t py = 0; py < rows; ++py)
+                for (uint32_t x = 0; x < cols; ++x)
+                    sum += px[(py * 4 + x) * strip_bpp + c];
+            out[c] = (uint8_t)(sum / n);
+        }
+        if (strip_bpp < bpp)
+            out[2] = bc5_z_table()[(size_t)out[0] << 8 | out[1]];
+    }
+}
+
+// One scanline of a preview: the mean of each block of a block row, over
+// the texels of the first `rows` (1..4) scanlines and w columns.
+static void block_mean_row(const dds_format_info* fi, const uint8_t* blocks, uint32_t blocks_x, uint8_t* row,
+                           uint32_t w, uint32_t rows)
+{
+    switch (fi->dxgi) {
+    case DXGI_FORMAT_BC1_UNORM: mean_row_with(blocks, blocks_x, row, w, rows,  8, 4, bc1_mean, bc1_strip, 4); break;
+    case DXGI_FORMAT_BC2_UNORM: mean_row_with(blocks, blocks_x, row, w, rows, 16, 4, bc2_mean, bc2_strip, 4); break;
+    case DXGI_FORMAT_BC3_UNORM: mean_row_with(blocks, blocks_x, row, w, rows, 16, 4, bc3_mean, bc3_strip, 4); break;
+    case DXGI_FORMAT_BC4_UNORM: mean_row_with(blocks, blocks_x, row, w, rows,  8, 1, bc4_mean, bc4_strip, 1); break;
+    case DXGI_FORMAT_BC5_UNORM:
+        if (fi->bpp == 2)
+            mean_row_with(blocks, blocks_x, row, w, rows, 16, 2, bc5_xy_mean, bc5_xy_strip, 2);
+        else
+            mean_row_with(blocks, blocks_x, row, w, rows, 16, 3, bc5_rgb_mean, bc5_xy_strip, 2);
+        break;
+    case DXGI_FORMAT_BC7_UNORM: mean_row_with(blocks, blocks_x, row, w, rows, 16, 4, bc7_mean, bc7_strip, 4); break;
+    default: break;
+    }
+}
+
+// Multithreaded decode: each task decodes one block row into its own
+// 4-scanline slice of the band (one scanline for a preview), so tasks never
+// share output bytes and the result is identical to the serial path.
+#define DECODE_BAND_ROWS_PER_THREAD 4
+
+typedef struct {
+    const dds_format_info* fi; // output layout (see dds_convert)
+    const uint8_t* blocks; // block payload
+    size_t row_stride;     // bytes per block row
+    uint32_t blocks_x;
+    uint8_t* band;         // band_blocks * 4 scanlines in PNG layout
+    size_t stride;         // bytes per scanline, filter byte included
+    uint32_t w;            // of the mip, in texels
+    uint32_t h;
+    uint32_t first_by;     // block row at the top of the band
+    int preview;           // one scanline of block means per block row
+} decode_band_job;
+
+static void decode_band_task(void* arg, size_t i)
+{
+    const decode_band_job* job = (const decode_band_job*)arg;
+    const uint32_t by = job->first_by + (uint32_t)i;
+    const uint32_t rows = (job->h - by * 4 < 4) ? job->h - by * 4 : 4;
+
+    if (job->preview) {
+        block_mean_row(job->fi, job->blocks + (size_t)by * job->row_stride, job->blocks_x,
+                       job->band + i * job->stride + 1, job->w, rows);
+        return;
+    }
+
+    decode_block_row(job->fi, job->blocks + (size_t)by * job->row_stride, job->blocks_x,
+                     job->band + i * 4u * job->stride + 1, job->stride, job->w, rows);
+}
+
+// ----------------------- Compression Profiles -----------------------
+
+// Rough single-core deflate throughput per level on filtered BC output, in MB
+// of scanline bytes per second. Only used to turn a time budget into a level.
+static const double g_deflate_level_mbps[10] = { 400, 95, 90, 80, 60, 45, 35, 25, 12, 5 };
+
+static const char* const g_strategy_names[5] = { "default", "filtered", "huffman", "rle", "fixed" };
+
+static const char* const g_bc5_output_names[2] = { "rgb", "xy" };
+
+// Fill in the per-image choices: the level under a time budget and the
+// strategy when it is left to us.
+static void resolve_deflate_options(const dds2png_options* opts, const dds_format_info* fi,
+                                    uint32_t w, uint32_t h, dds2png_options* out)
+{
+    *out = *opts;
+
+    if (opts->time_budget_ms > 0.0) {
+        const double mb = ((double)w * fi->bpp + 1.0) * h / 1e6;
+        int level = opts->level;
+        while (level > 1 && mb / g_deflate_level_mbps[level] * 1000.0 > opts->time_budget_ms)
+            --level;
+        out->level = level;
+    }
+
+    if (opts->strategy == DDS2PNG_STRATEGY_AUTO) {
+        if (fi->dxgi == DXGI_FORMAT_BC4_UNORM)
+            out->strategy = Z_RLE;
+        else if (opts->filter != DDS2PNG_FILTER_NONE)
+            out->strategy = Z_FILTERED;
+        else
+            out->strategy = Z_DEFAULT_STRATEGY;
+    }
+}
+
+// Per-file cost of opening, mapping and writing, in ms (cost estimates only).
+#define DDS_FILE_OVERHEAD_MS 0.05
+
+// Rough single-core time to convert a w x h image in layout fi under opts, in
+// ms: decode at the format's rate, deflate at the chosen level's.
+static double estimate_convert_ms(const dds2png_options* opts, const dds_format_info* fi, uint32_t w, uint32_t h)
+{
+    dds2png_options z;
+    resolve_deflate_options(opts, fi, w, h, &z);
+
+    // RLE and Huffman-only skip the match search and run at level 1 speed.
+    int level = z.level;
+    if ((z.strategy == Z_RLE || z.strategy == Z_HUFFMAN_ONLY) && level > 1)
+        level = 1;
+
+    const double mb = ((double)w * fi->bpp + 1.0) * h / 1e6;
+    return DDS_FILE_OVERHEAD_MS + (double)w * h / (fi->decode_mpps * 1e3) + mb / g_deflate_level_mbps[level] * 1000.0;
+}
+
+static int parse_int_arg(const char* flag, const char* value, int lo, int hi, int* out)
+{
+    char* end = NULL;
+    long v = value ? strtol(value, &end, 10) : 0;
+    if (!value || *value == '\0' || *end != '\0' || v < lo || v > hi) {
+        fprintf(stderr, "ERROR: %s expects a number in %d..%d\n", flag, lo, hi);
+        return -1;
+    }
+    *out = (int)v;
+    return 2;
+}
+
+static int parse_name_arg(const char* flag, const char* value, const char* const* names, int count, int* out)
+{
+    for (int i = 0; value && i < count; ++i) {
+        if (strcmp(value, names[i]) == 0) {
+            *out = i;
+            return 2;
         }
+    }
+    fprintf(stderr, "ERROR: %s expects one of:", flag);
+    for (int i = 0; i < count; ++i)
+        fprintf(stderr, " %s", names[i]);
+    fprintf(stderr, "\n");
+    return -1;
+}
 
-        uint32_t w = hdr.dwWidth;
-        uint32_t h = hdr.dwHeight;
+#ifdef __cplusplus
+extern "C" {
+    #endif
 
-        if (w == 0 || h == 0) {
-            fclose(f);
+    void dds2png_options_init(dds2png_options* opts)
+    {
+        memset(opts, 0, sizeof(*opts));
+        dds2png_options_preset(opts, "balanced");
+    }
+
+    int dds2png_options_preset(dds2png_options* opts, const char* name)
+    {
+        int level, mem_level, filter;
+
+        if (strcmp(name, "fast") == 0) {
+            level = 1; mem_level = 8; filter = DDS2PNG_FILTER_UP;
+        } else if (strcmp(name, "balanced") == 0) {
+            level = 6; mem_level = 8; filter = DDS2PNG_FILTER_ADAPTIVE;
+        } else if (strcmp(name, "archive") == 0) {
+            level = 9; mem_level = 9; filter = DDS2PNG_FILTER_ADAPTIVE;
+        } else {
             return 1;
         }
 
-        uint32_t fmt = dx10.dxgiFormat;
-        uint32_t blocks_x = (w + 3) / 4;
-        uint32_t blocks_y = (h + 3) / 4;
-        uint64_t block_count = (uint64_t)blocks_x * blocks_y;
+        opts->level       = level;
+        opts->strategy    = DDS2PNG_STRATEGY_AUTO;
+        opts->mem_level   = mem_level;
+        opts->window_bits = 15;
+        opts->filter      = filter;
+        if (opts->threads < 1)
+            opts->threads = 1;
+        return 0;
+    }
 
-        // ---------------- BC1 (71) ----------------
-        if (fmt == DXGI_FORMAT_BC1_UNORM)
-        {
-            size_t bc_bytes = (size_t)block_count * 8u;
-            uint8_t* bc = (uint8_t*)malloc(bc_bytes);
-            if (!bc) {
-                fclose(f);
-                return 1;
+    int dds2png_parse_option(dds2png_options* opts, const char* flag, const char* value)
+    {
+        if (strcmp(flag, "--preset") == 0) {
+            if (!value || dds2png_options_preset(opts, value) != 0) {
+                fprintf(stderr, "ERROR: --preset expects one of: fast balanced archive\n");
+                return -1;
             }
-
-            if (fread(bc, 1, bc_bytes, f) != bc_bytes) {
-                free(bc);
-                fclose(f);
-                return 1;
+            return 2;
+        }
+        if (strcmp(flag, "--level") == 0)
+            return parse_int_arg(flag, value, 0, 9, &opts->level);
+        if (strcmp(flag, "--mem-level") == 0)
+            return parse_int_arg(flag, value, 1, 9, &opts->mem_level);
+        if (strcmp(flag, "--window-bits") == 0)
+            return parse_int_arg(flag, value, 9, 15, &opts->window_bits);
+        if (strcmp(flag, "--filter") == 0)
+            return parse_name_arg(flag, value, g_png_filter_names, 6, &opts->filter);
+        if (strcmp(flag, "--strategy") == 0) {
+            if (value && strcmp(value, "auto") == 0) {
+                opts->strategy = DDS2PNG_STRATEGY_AUTO;
+                return 2;
             }
-            fclose(f);
+            return parse_name_arg(flag, value, g_strategy_names, 5, &opts->strategy);
+        }
+        if (strcmp(flag, "--bc5") == 0)
+            return parse_name_arg(flag, value, g_bc5_output_names, 2, &opts->bc5_output);
+        if (strcmp(flag, "--max-dim") == 0) {
+            int dim = 0;
+            if (parse_int_arg(flag, value, 0, 65536, &dim) < 0)
+                return -1;
+            opts->max_dim = (uint32_t)dim;
+            return 2;
+        }
+        if (strcmp(flag, "--time-budget") == 0) {
+            int ms = 0;
+            if (parse_int_arg(flag, value, 0, 3600000, &ms) < 0)
+                return -1;
+            opts->time_budget_ms = ms;
+            return 2;
+        }
+        return 0;
+    }
 
-            uint8_t* img = (uint8_t*)malloc((size_t)w * h * 4u);
-            if (!img) {
-                free(bc);
-                return 1;
-            }
+    #ifdef __cplusplus
+}
+#endif
 
-            for (uint32_t by = 0; by < blocks_y; ++by) {
-                for (uint32_t bx = 0; bx < blocks_x; ++bx) {
-                    const uint8_t* blk = bc + ((uint64_t)by * blocks_x + bx) * 8u;
-                    uint8_t rgba_block[16 * 4];
-                    decode_bc1_block(blk, rgba_block);
-
-                    for (uint32_t py = 0; py < 4; ++py) {
-                        for (uint32_t px = 0; px < 4; ++px) {
-                            uint32_t x = bx * 4 + px;
-                            uint32_t y = by * 4 + py;
-                            if (x >= w || y >= h) continue;
-
-                            size_t dst = ((size_t)y * w + x) * 4u;
-                            size_t src = (py * 4 + px) * 4u;
-
-                            img[dst + 0] = rgba_block[src + 0];
-                            img[dst + 1] = rgba_block[src + 1];
-                            img[dst + 2] = rgba_block[src + 2];
-                            img[dst + 3] = rgba_block[src + 3];
-                        }
-                    }
-                }
-            }
+// ----------------------- Main Conversion Function -----------------------
 
-            int ret = write_png_rgba8(output, w, h, img);
-            free(img);
-            free(bc);
-            return ret;
-        }
+// What a conversion produced; filled in on success.
+typedef struct {
+    uint32_t dxgi;
+    uint32_t width;
+    uint32_t height;
+    uint64_t png_bytes;
+} dds_convert_result;
 
-        // ---------------- BC2 (74) ----------------
-        if (fmt == DXGI_FORMAT_BC2_UNORM)
-        {
-            size_t bc_bytes = (size_t)block_count * 16u;
-            uint8_t* bc = (uint8_t*)malloc(bc_bytes);
-            if (!bc) {
-                fclose(f);
-                return 1;
-            }
+// A mapped DDS file whose header has been checked.
+typedef struct {
+    dds_input in;
+    uint32_t width;
+    uint32_t height;
+    uint32_t dxgi;
+    const dds_format_info* fi;
+    uint32_t blocks_x;
+    uint32_t blocks_y;
+    const uint8_t* blocks; // the mip being converted, read in place from the mapping
+    uint32_t mip;          // its level
+    int preview;           // convert at one pixel per block (dds_preview_size)
+} dds_image;
+
+// Check the magic, DDS and DX10 headers at the start of a file (`size` bytes
+// available). Returns the format and fills in the top mip's size and the
+// mip count (at least 1), or NULL; errors worth reporting are printed
+// against `input` unless it is NULL.
+static const dds_format_info* dds_parse_header(const uint8_t* data, size_t size, const char* input,
+                                               uint32_t* width, uint32_t* height, uint32_t* mips)
+{
+    // Check magic
+    uint32_t magic = 0;
+    if (size >= 4)
+        memcpy(&magic, data, 4);
+    if (magic != DDS_MAGIC)
+        return NULL;
+
+    // Read DDS header
+    DDS_HEADER hdr;
+    if (size < 4 + sizeof(hdr))
+        return NULL;
+    memcpy(&hdr, data + 4, sizeof(hdr));
+
+    // We only support DX10 extended header
+    if (hdr.ddspf.dwFourCC != DDS_FOURCC('D','X','1','0')) {
+        if (input)
+            fprintf(stderr, "ERROR: non-DX10 DDS unsupported: %s\n", input);
+        return NULL;
+    }
 
-            if (fread(bc, 1, bc_bytes, f) != bc_bytes) {
-                free(bc);
-                fclose(f);
-                return 1;
-            }
-            fclose(f);
+    DDS_HEADER_DX10 dx10;
+    if (size < DDS_DX10_DATA_OFFSET)
+        return NULL;
+    memcpy(&dx10, data + 4 + sizeof(hdr), sizeof(dx10));
+
+    if (hdr.dwWidth == 0 || hdr.dwHeight == 0)
+        return NULL;
+
+    uint32_t fmt = dx10.dxgiFormat;
+    const dds_format_info* fi = dds_find_format(fmt);
+    if (!fi) {
+        if (input)
+            fprintf(stderr,
+                    "ERROR: Unsupported DXGI format %u in '%s' (BC1=71, BC2=74, BC3=77, BC4=80, BC5=83, BC7=98)\n",
+                    fmt, input);
+        return NULL;
+    }
 
-            uint8_t* img = (uint8_t*)malloc((size_t)w * h * 4u);
-            if (!img) {
-                free(bc);
-                return 1;
-            }
+    *width = hdr.dwWidth;
+    *height = hdr.dwHeight;
+    *mips = (hdr.dwMipMapCount > 1 && hdr.dwMipMapCount <= 32) ? hdr.dwMipMapCount : 1;
+    return fi;
+}
 
-            for (uint32_t by = 0; by < blocks_y; ++by) {
-                for (uint32_t bx = 0; bx < blocks_x; ++bx) {
-                    const uint8_t* blk = bc + ((uint64_t)by * blocks_x + bx) * 16u;
-
-                    // First 8 bytes: alpha; next 8 bytes: BC1 color
-                    uint8_t alpha_block[8];
-                    memcpy(alpha_block, blk, 8);
-                    uint8_t alpha[16];
-                    decode_bc2_alpha(alpha_block, alpha);
-
-                    uint8_t rgba_color[16 * 4];
-                    decode_bc1_block(blk + 8, rgba_color);
-
-                    for (uint32_t py = 0; py < 4; ++py) {
-                        for (uint32_t px = 0; px < 4; ++px) {
-                            uint32_t x = bx * 4 + px;
-                            uint32_t y = by * 4 + py;
-                            if (x >= w || y >= h) continue;
-
-                            size_t dst = ((size_t)y * w + x) * 4u;
-                            size_t idx = (size_t)py * 4 + px;
-                            size_t src = idx * 4u;
-
-                            img[dst + 0] = rgba_color[src + 0];
-                            img[dst + 1] = rgba_color[src + 1];
-                            img[dst + 2] = rgba_color[src + 2];
-                            img[dst + 3] = alpha[idx];
-                        }
-                    }
-                }
-            }
+// The mip dds2png_options::max_dim selects: the smallest level whose longer
+// side is still at least max_dim, or level 0 when max_dim is 0 or the image
+// is smaller. Levels are stored largest first after the headers, so level
+// n starts after the blocks of levels 0..n-1; levels past the end of
+// `payload` bytes are not considered. Returns the level and replaces *w,
+// *h with its size and *offset with the payload offset of its blocks.
+static uint32_t dds_select_mip(const dds_format_info* fi, uint32_t mips, uint32_t max_dim, uint64_t payload,
+                               uint32_t* w, uint32_t* h, uint64_t* offset)
+{
+    uint32_t level = 0;
+    *offset = 0;
+    while (max_dim && level + 1 < mips) {
+        const uint32_t nw = (*w > 1) ? *w / 2 : 1;
+        const uint32_t nh = (*h > 1) ? *h / 2 : 1;
+        if ((nw > nh ? nw : nh) < max_dim)
+            break;
+
+        const uint64_t bytes = (uint64_t)((*w + 3) / 4) * ((*h + 3) / 4) * fi->block_bytes;
+        const uint64_t next_bytes = (uint64_t)((nw + 3) / 4) * ((nh + 3) / 4) * fi->block_bytes;
+        if (*offset + bytes + next_bytes > payload)
+            break;
+
+        *offset += bytes;
+        *w = nw;
+        *h = nh;
+        level++;
+    }
+    return level;
+}
+
+// Whether a w x h mip is converted as a preview, one pixel per block
+// (rounded up at partial edges): when max_dim is set and even a quarter of
+// the mip, rounded down, still has a side of max_dim or more (no mip chain,
+// or one that stops short). Fills in the PNG's size either way, unless
+// out_w is NULL.
+static int dds_preview_size(uint32_t max_dim, uint32_t w, uint32_t h, uint32_t* out_w, uint32_t* out_h)
+{
+    const uint32_t bw = (w + 3) / 4, bh = (h + 3) / 4;
+    const int preview = max_dim && (w > h ? w : h) / 4 >= max_dim;
+    if (out_w) {
+        *out_w = preview ? bw : w;
+        *out_h = preview ? bh : h;
+    }
+    return preview;
+}
+
+// Validate the header and payload size of `in` (named `input` in errors),
+// pick the mip to convert (see dds_select_mip) and take `in` over. Returns
+// 0, or 1 with `in` still the caller's.
+static int dds_image_load(dds_image* img, const dds_input* in, const char* input, uint32_t max_dim)
+{
+    memset(img, 0, sizeof(*img));
 
-            int ret = write_png_rgba8(output, w, h, img);
-            free(img);
-            free(bc);
-            return ret;
+    uint32_t w = 0, h = 0, mips = 1;
+    const dds_format_info* fi = dds_parse_header(in->data, in->size, input, &w, &h, &mips);
+    if (!fi)
+        return 1;
+    const uint32_t fmt = fi->dxgi;
+
+    const uint64_t payload = (uint64_t)(in->size - DDS_DX10_DATA_OFFSET);
+    uint64_t offset = 0;
+    const uint32_t mip = dds_select_mip(fi, mips, max_dim, payload, &w, &h, &offset);
+
+    uint32_t blocks_x = (w + 3) / 4;
+    uint32_t blocks_y = (h + 3) / 4;
+    uint64_t block_count = (uint64_t)blocks_x * blocks_y;
+
+    if (offset + block_count * fi->block_bytes > payload)
+        return 1;
+    dds_input_will_read(in, (size_t)(DDS_DX10_DATA_OFFSET + offset), (size_t)(block_count * fi->block_bytes));
+
+    img->in       = *in;
+    img->width    = w;
+    img->height   = h;
+    img->dxgi     = fmt;
+    img->fi       = fi;
+    img->blocks_x = blocks_x;
+    img->blocks_y = blocks_y;
+    img->blocks   = in->data + DDS_DX10_DATA_OFFSET + offset;
+    img->mip      = mip;
+    img->preview  = dds_preview_size(max_dim, w, h, NULL, NULL);
+    return 0;
+}
+
+// Open `input` and validate it. Returns 0, or 1 with nothing left open.
+static int dds_image_open(dds_image* img, const char* input, uint32_t max_dim)
+{
+    dds_input in;
+    if (dds_input_open(&in, input) != 0) {
+        fprintf(stderr, "ERROR: cannot open '%s'\n", input);
+        return 1;
+    }
+    if (dds_image_load(img, &in, input, max_dim) != 0) {
+        dds_input_close(&in);
+        return 1;
+    }
+    return 0;
+}
+
+// Validate a DDS file the caller already holds in memory; it is read in
+// place and must outlive the image.
+static int dds_image_open_memory(dds_image* img, const void* data, size_t size, const char* name, uint32_t max_dim)
+{
+    dds_input in;
+    memset(&in, 0, sizeof(in));
+    in.data = (const uint8_t*)data;
+    in.size = size;
+    return dds_image_load(img, &in, name, max_dim);
+}
+
+static void dds_image_close(dds_image* img)
+{
+    dds_input_close(&img->in);
+}
+
+// Convert an opened image, which is closed on return. The PNG goes to the
+// file `output`, or else to write(); with neither it is only counted. Every
+// buffer comes from ctx's arena, which is reset here: whatever the previous
+// conversion got from it is gone.
+static int dds_convert_image(dds2png_context* ctx, dds_image* image, const char* output,
+                             dds2png_write_fn write, void* write_user,
+                             const dds2png_options* opts, dds_convert_result* result)
+{
+    dds_arena_reset(&ctx->arena);
+
+    dds_image img = *image;
+
+    // A preview's PNG has one pixel per block, one scanline per block row
+    const uint32_t w = img.preview ? img.blocks_x : img.width;
+    const uint32_t h = img.preview ? img.blocks_y : img.height;
+    const uint32_t block_rows = img.preview ? 1 : 4;
+    const uint32_t fmt = img.dxgi;
+    const uint32_t blocks_x = img.blocks_x;
+    const uint32_t blocks_y = img.blocks_y;
+    const uint8_t* bc = img.blocks;
+
+    const dds_format_info out_fi = dds_output_format(img.fi, opts);
+    const dds_format_info* fi = &out_fi;
+
+    // A band of block rows, decoded in parallel (one block row per task)
+    // and then streamed to the encoder in order. Scanlines are laid out as
+    // PNG rows (filter byte, then pixels) so unfiltered bands deflate as-is.
+    const int threads = (opts->threads > 1) ? opts->threads : 1;
+    const uint32_t band_blocks = (threads > 1) ? (uint32_t)threads * DECODE_BAND_ROWS_PER_THREAD : 1;
+    const size_t stride = 1 + (size_t)w * fi->bpp;
+    uint8_t* band = (uint8_t*)dds_arena_alloc(&ctx->arena, stride * block_rows * band_blocks);
+    if (!band) {
+        dds_image_close(&img);
+        return 1;
+    }
+
+    dds2png_options z;
+    resolve_deflate_options(opts, fi, w, h, &z);
+
+    png_stream ps;
+    if (png_stream_begin(&ps, ctx, output, write, write_user, w, h, fi->color_type, fi->bpp, &z) != 0) {
+        dds_image_close(&img);
+        return 1;
+    }
+
+    decode_band_job job;
+    job.fi         = fi;
+    job.blocks     = bc;
+    job.row_stride = (size_t)blocks_x * fi->block_bytes;
+    job.blocks_x   = blocks_x;
+    job.band       = band;
+    job.stride     = stride;
+    job.w          = img.width;  // of the mip, also for a preview
+    job.h          = img.height;
+    job.preview    = img.preview;
+
+    int ret = 0;
+    for (uint32_t by = 0; by < blocks_y && ret == 0; by += band_blocks) {
+        uint32_t count = (blocks_y - by < band_blocks) ? blocks_y - by : band_blocks;
+        job.first_by = by;
+        dds_options_parallel_for(opts, threads, count, decode_band_task, &job);
+
+        uint32_t y_end = (by + count) * block_rows < h ? (by + count) * block_rows : h;
+        ret = png_stream_write_rows(&ps, band, stride, y_end - by * block_rows);
+    }
+
+    if (ret == 0)
+        ret = png_stream_finish(&ps);
+    else
+        png_stream_abort(&ps);
+
+    if (ret == 0 && result) {
+        result->dxgi      = fmt;
+        result->width     = w;
+        result->height    = h;
+        result->png_bytes = ps.bytes_out;
+    }
+
+    dds_image_close(&img);
+    return ret;
+}
+
+// zlib crc32 of a buffer of any size (crc32 takes 32-bit lengths).
+static uint32_t dds_crc32(const uint8_t* data, size_t size)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    while (size > 0) {
+        uInt n = size < ((size_t)1 << 30) ? (uInt)size : (1u << 30);
+        crc = crc32(crc, data, n);
+        data += n;
+        size -= n;
+    }
+    return (uint32_t)crc;
+}
+
+// Convert one file. A NULL output encodes without writing anything. With
+// input_crc, the whole file's crc32 is taken from the mapping first.
+static int dds_convert(dds2png_context* ctx, const char* input, const char* output, const dds2png_options* opts,
+                       dds_convert_result* result, uint32_t* input_crc)
+{
+    dds_image img;
+    if (dds_image_open(&img, input, opts->max_dim) != 0)
+        return 1;
+    if (input_crc) {
+        dds_input_will_read(&img.in, 0, img.in.size);
+        *input_crc = dds_crc32(img.in.data, img.in.size);
+    }
+    return dds_convert_image(ctx, &img, output, NULL, NULL, opts, result);
+}
+
+#ifdef __cplusplus
+extern "C" {
+    #endif
+
+    int dds2png_convert(const char* input, const char* output)
+    {
+        return dds2png_convert_ex(input, output, NULL);
+    }
+
+    int dds2png_convert_ex(const char* input, const char* output, const dds2png_options* opts)
+    {
+        dds2png_options defaults;
+        if (!opts) {
+            dds2png_options_init(&defaults);
+            opts = &defaults;
         }
 
-        // ---------------- BC3 (77) ----------------
-        if (fmt == DXGI_FORMAT_BC3_UNORM)
-        {
-            size_t bc_bytes = (size_t)block_count * 16u;
-            uint8_t* bc = (uint8_t*)malloc(bc_bytes);
-            if (!bc) {
-                fclose(f);
-                return 1;
-            }
+        dds2png_context ctx;
+        dds_context_init(&ctx);
+        int ret = dds_convert(&ctx, input, output, opts, NULL, NULL);
+        dds_context_release(&ctx);
+        return ret;
+    }
 
-            if (fread(bc, 1, bc_bytes, f) != bc_bytes) {
-                free(bc);
-                fclose(f);
-                return 1;
-            }
-            fclose(f);
+    int dds2png_probe(const char* input, const dds2png_options* opts, dds2png_probe_info* info)
+    {
+        uint8_t head[DDS_DX10_DATA_OFFSET];
+        FILE* f = fopen(input, "rb");
+        if (!f)
+            return 1;
+        size_t got = fread(head, 1, sizeof(head), f);
+        long size = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+        fclose(f);
 
-            uint8_t* img = (uint8_t*)malloc((size_t)w * h * 4u);
-            if (!img) {
-                free(bc);
-                return 1;
-            }
+        uint32_t w = 0, h = 0, mips = 1;
+        const dds_format_info* fi = dds_parse_header(head, got, NULL, &w, &h, &mips);
+        if (!fi)
+            return 1;
 
-            for (uint32_t by = 0; by < blocks_y; ++by) {
-                for (uint32_t bx = 0; bx < blocks_x; ++bx) {
-                    const uint8_t* blk = bc + ((uint64_t)by * blocks_x + bx) * 16u;
+        dds2png_options defaults;
+        if (!opts) {
+            dds2png_options_init(&defaults);
+            opts = &defaults;
+        }
+        const dds_format_info out_fi = dds_output_format(fi, opts);
+
+        uint64_t offset = 0;
+        const uint64_t payload = size > (long)DDS_DX10_DATA_OFFSET ? (uint64_t)size - DDS_DX10_DATA_OFFSET : 0;
+        dds_select_mip(fi, mips, opts->max_dim, payload, &w, &h, &offset);
+        const int preview = dds_preview_size(opts->max_dim, w, h, &w, &h);
+
+        info->width  = w;
+        info->height = h;
+        info->dxgi   = fi->dxgi;
+        info->est_ms = estimate_convert_ms(opts, &out_fi, w, h);
+        if (preview) // a block mean costs roughly 4 pixels of a full decode
+            info->est_ms += (double)w * h * 3.0 / (out_fi.decode_mpps * 1e3);
+        info->file_size = size > 0 ? (uint64_t)size : 0;
+        return 0;
+    }
 
-                    // First 8 bytes: BC4-style alpha; next 8 bytes: BC1 color
-                    uint8_t alpha[16];
-                    decode_bc4_block(blk, alpha);
+    int dds2png_get_block_stats(uint32_t dxgi, dds2png_block_stats* stats)
+    {
+        const dds_format_info* fi = dds_find_format(dxgi);
+        memset(stats, 0, sizeof(*stats));
+        if (!fi)
+            return 1;
 
-                    uint8_t rgba_color[16 * 4];
-                    decode_bc1_block(blk + 8, rgba_color);
+        const uint64_t* counts = g_block_stats[fi - g_dds_formats];
+        stats->blocks   = __atomic_load_n(&counts[DDS_STAT_BLOCKS], __ATOMIC_RELAXED);
+        stats->uniform  = __atomic_load_n(&counts[DDS_STAT_UNIFORM], __ATOMIC_RELAXED);
+        stats->repeated = __atomic_load_n(&counts[DDS_STAT_REPEATED], __ATOMIC_RELAXED);
+        return 0;
+    }
 
-                    for (uint32_t py = 0; py < 4; ++py) {
-                        for (uint32_t px = 0; px < 4; ++px) {
-                            uint32_t x = bx * 4 + px;
-                            uint32_t y = by * 4 + py;
-                            if (x >= w || y >= h) continue;
+    dds2png_context* dds2png_context_create(void)
+    {
+        dds2png_context* ctx = (dds2png_context*)malloc(sizeof(dds2png_context));
+        if (ctx)
+            dds_context_init(ctx);
+        return ctx;
+    }
 
-                            size_t dst = ((size_t)y * w + x) * 4u;
-                            size_t idx = (size_t)py * 4 + px;
-                            size_t src = idx * 4u;
+    void dds2png_context_destroy(dds2png_context* ctx)
+    {
+        if (!ctx)
+            return;
+        dds_context_release(ctx);
+        free(ctx);
+    }
 
-                            img[dst + 0] = rgba_color[src + 0];
-                            img[dst + 1] = rgba_color[src + 1];
-                            img[dst + 2] = rgba_color[src + 2];
-                            img[dst + 3] = alpha[idx];
-                        }
-                    }
-                }
-            }
+    int dds2png_convert_ctx(dds2png_context* ctx, const char* input, const char* output, const dds2png_options* opts)
+    {
+        if (!ctx || !opts)
+            return dds2png_convert_ex(input, output, opts);
+        return dds_convert(ctx, input, output, opts, NULL, NULL);
+    }
 
-            int ret = write_png_rgba8(output, w, h, img);
-            free(img);
-            free(bc);
-            return ret;
+    int dds2png_convert_crc(dds2png_context* ctx, const char* input, const char* output,
+                            const dds2png_options* opts, uint32_t* input_crc)
+    {
+        if (!ctx || !opts)
+            return 1;
+        return dds_convert(ctx, input, output, opts, NULL, input_crc);
+    }
+
+    int dds2png_convert_memory(dds2png_context* ctx, const void* data, size_t size, const char* name,
+                               dds2png_write_fn write, void* user, const dds2png_options* opts)
+    {
+        dds2png_options defaults;
+        if (!opts) {
+            dds2png_options_init(&defaults);
+            opts = &defaults;
         }
 
-        // ---------------- BC4 (80) ----------------
-        if (fmt == DXGI_FORMAT_BC4_UNORM)
-        {
-            size_t bc_bytes = (size_t)block_count * 8u;
-            uint8_t* bc = (uint8_t*)malloc(bc_bytes);
-            if (!bc) {
-                fclose(f);
-                return 1;
-            }
+        dds_image img;
+        if (dds_image_open_memory(&img, data, size, name, opts->max_dim) != 0)
+            return 1;
 
-            if (fread(bc, 1, bc_bytes, f) != bc_bytes) {
-                free(bc);
-                fclose(f);
-                return 1;
-            }
-            fclose(f);
+        if (ctx)
+            return dds_convert_image(ctx, &img, NULL, write, user, opts, NULL);
 
-            uint8_t* img = (uint8_t*)malloc((size_t)w * h);
-            if (!img) {
-                free(bc);
-                return 1;
-            }
+        dds2png_context local;
+        dds_context_init(&local);
+        int ret = dds_convert_image(&local, &img, NULL, write, user, opts, NULL);
+        dds_context_release(&local);
+        return ret;
+    }
 
-            for (uint32_t by = 0; by < blocks_y; ++by) {
-                for (uint32_t bx = 0; bx < blocks_x; ++bx) {
-                    const uint8_t* blk = bc + ((uint64_t)by * blocks_x + bx) * 8u;
-                    uint8_t block_pixels[16];
-                    decode_bc4_block(blk, block_pixels);
-
-                    for (uint32_t py = 0; py < 4; ++py) {
-                        for (uint32_t px = 0; px < 4; ++px) {
-                            uint32_t x = bx * 4 + px;
-                            uint32_t y = by * 4 + py;
-                            if (x < w && y < h) {
-                                img[(size_t)y * w + x] = block_pixels[py * 4 + px];
-                            }
-                        }
-                    }
-                }
-            }
+    #ifdef __cplusplus
+}
+#endif
+
+// ----------------------- Optional Standalone Main -----------------------
+
+#ifdef STANDALONE
+#include <time.h>
+
+#define DDS_FORMAT_COUNT (sizeof(g_dds_formats) / sizeof(g_dds_formats[0]))
 
-            int ret = write_png_gray8(output, w, h, img);
-            free(img);
-            free(bc);
-            return ret;
+static double bench_now_ms(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+// dds2png [options] --bench a.dds [b.dds ...]
+//
+// Converts every input without writing anything and prints, per DXGI format,
+// the PNG size and time of each filter mode (at the selected compression
+// settings) and of each named preset. Decode cost is the same in every row,
+// so the time differences are the encoder's. BC7 inputs also get a decode-only
+// table per block mode: per-block decode vs. the batch (SIMD) path.
+#define BENCH_ROWS 9 // 6 filter modes + 3 presets
+
+static int run_bench(const dds2png_options* base, int count, char** files)
+{
+    static const char* const presets[3] = { "fast", "balanced", "archive" };
+    static double   ms[DDS_FORMAT_COUNT][BENCH_ROWS];
+    static uint64_t bytes[DDS_FORMAT_COUNT][BENCH_ROWS];
+    static uint64_t pixels[DDS_FORMAT_COUNT];
+    static int      nfiles[DDS_FORMAT_COUNT];
+    static bc7_mode_timing bc7_modes[8];
+    dds2png_context ctx;
+    dds_context_init(&ctx);
+
+    for (int i = 0; i < count; ++i) {
+        dds_image img;
+        if (dds_image_open(&img, files[i], base->max_dim) == 0) {
+            if (img.dxgi == DXGI_FORMAT_BC7_UNORM)
+                bc7_time_modes(img.blocks, (size_t)img.blocks_x * img.blocks_y, bc7_modes);
+            dds_image_close(&img);
         }
 
-        // ---------------- BC5 (83) ----------------
-        if (fmt == DXGI_FORMAT_BC5_UNORM)
-        {
-            size_t bc_bytes = (size_t)block_count * 16u;
-            uint8_t* bc = (uint8_t*)malloc(bc_bytes);
-            if (!bc) {
-                fclose(f);
-                return 1;
+        for (int row = 0; row < BENCH_ROWS; ++row) {
+            dds2png_options opts = *base;
+            if (row <= DDS2PNG_FILTER_ADAPTIVE)
+                opts.filter = row;
+            else
+                dds2png_options_preset(&opts, presets[row - DDS2PNG_FILTER_ADAPTIVE - 1]);
+
+            dds_convert_result res;
+            double t0 = bench_now_ms();
+            if (dds_convert(&ctx, files[i], NULL, &opts, &res, NULL) != 0)
+                break;
+            double t1 = bench_now_ms();
+
+            size_t fi = (size_t)(dds_find_format(res.dxgi) - g_dds_formats);
+            ms[fi][row]    += t1 - t0;
+            bytes[fi][row] += res.png_bytes;
+            if (row == 0) {
+                pixels[fi] += (uint64_t)res.width * res.height;
+                nfiles[fi]++;
             }
+        }
+    }
+    dds_context_release(&ctx);
+
+    for (size_t fi = 0; fi < DDS_FORMAT_COUNT; ++fi) {
+        if (!nfiles[fi]) continue;
+
+        const double raw = (double)pixels[fi] * g_dds_formats[fi].bpp;
+        printf("DXGI %u: %d file(s), %.2f Mpx\n", g_dds_formats[fi].dxgi, nfiles[fi], (double)pixels[fi] / 1e6);
+        printf("  %-16s %14s %8s %10s\n", "mode", "png bytes", "ratio", "ms");
+        for (int row = 0; row < BENCH_ROWS; ++row) {
+            char label[32];
+            if (row <= DDS2PNG_FILTER_ADAPTIVE)
+                snprintf(label, sizeof(label), "filter %s", g_png_filter_names[row]);
+            else
+                snprintf(label, sizeof(label), "preset %s", presets[row - DDS2PNG_FILTER_ADAPTIVE - 1]);
+            printf("  %-16s %14llu %7.3f %10.1f\n", label,
+                   (unsigned long long)bytes[fi][row], (double)bytes[fi][row] / raw, ms[fi][row]);
+        }
+    }
 
-            if (fread(bc, 1, bc_bytes, f) != bc_bytes) {
-                free(bc);
-                fclose(f);
-                return 1;
-            }
-            fclose(f);
+    uint64_t bc7_blocks = 0;
+    for (int mode = 0; mode < 8; ++mode)
+        bc7_blocks += bc7_modes[mode].blocks;
+
+    if (bc7_blocks) {
+        printf("BC7 decode by mode (ns/block)\n");
+        printf("  %-6s %12s %10s %10s %8s\n", "mode", "blocks", "single", "batch", "speedup");
+        for (int mode = 0; mode < 8; ++mode) {
+            const bc7_mode_timing* t = &bc7_modes[mode];
+            if (!t->blocks) continue;
+            printf("  %-6d %12llu %10.1f %10.1f %7.2fx\n", mode, (unsigned long long)t->blocks,
+                   t->single_ms * 1e6 / (double)t->blocks, t->batch_ms * 1e6 / (double)t->blocks,
+                   t->batch_ms > 0.0 ? t->single_ms / t->batch_ms : 0.0);
+        }
+    }
+    return 0;
+}
 
-            uint8_t* img = (uint8_t*)malloc((size_t)w * h * 3u);
-            if (!img) {
-                free(bc);
-                return 1;
-            }
+// --stats: how often the decoders' fast paths were taken, per format.
+static void print_block_stats(void)
+{
+    printf("Decode fast paths\n");
+    printf("  %-6s %12s %12s %8s %12s %8s\n", "DXGI", "blocks", "uniform", "%", "repeated", "%");
+    for (size_t fi = 0; fi < DDS_FORMAT_COUNT; ++fi) {
+        dds2png_block_stats st;
+        dds2png_get_block_stats(g_dds_formats[fi].dxgi, &st);
+        if (!st.blocks) continue;
+        printf("  %-6u %12llu %12llu %7.1f%% %12llu %7.1f%%\n", g_dds_formats[fi].dxgi,
+               (unsigned long long)st.blocks,
+               (unsigned long long)st.uniform, 100.0 * (double)st.uniform / (double)st.blocks,
+               (unsigned long long)st.repeated, 100.0 * (double)st.repeated / (double)st.blocks);
+    }
+}
 
-            for (uint32_t by = 0; by < blocks_y; ++by) {
-                for (uint32_t bx = 0; bx < blocks_x; ++bx) {
-                    const uint8_t* blk = bc + ((uint64_t)by * blocks_x + bx) * 16u;
-
-                    uint8_t rx[16];
-                    uint8_t gy[16];
-                    decode_bc4_block(blk,     rx);
-                    decode_bc4_block(blk + 8, gy);
-
-                    for (uint32_t py = 0; py < 4; ++py) {
-                        for (uint32_t px = 0; px < 4; ++px) {
-                            uint32_t x = bx * 4 + px;
-                            uint32_t y = by * 4 + py;
-                            if (x >= w || y >= h) continue;
-
-                            double nx = (double)rx[py*4 + px] / 255.0 * 2.0 - 1.0;
-                            double ny = (double)gy[py*4 + px] / 255.0 * 2.0 - 1.0;
-                            double nz2 = 1.0 - nx*nx - ny*ny;
-                            double nz  = (nz2 > 0.0) ? sqrt(nz2) : 0.0;
-
-                            size_t idx = ((size_t)y * w + x) * 3u;
-                            img[idx + 0] = (uint8_t)((nx * 0.5 + 0.5) * 255.0 + 0.5);
-                            img[idx + 1] = (uint8_t)((ny * 0.5 + 0.5) * 255.0 + 0.5);
-                            img[idx + 2] = (uint8_t)((nz * 0.5 + 0.5) * 255.0 + 0.5);
-                        }
+// dds2png --selftest
+//
+// Checks the decoders against scalar references on synthetic blocks, without
+// any input files. Prints each failed check and returns 1 if any failed.
+
+// decode_bc4_blocks() (SSE2 or scalar) vs. the palette lookup, for every
+// (r0, r1) pair. Block k of a pair gives pixel i index (i + k) & 7, so each
+// index value lands on each pixel position; runs are decoded at the BC4 and
+// at the BC5 block stride.
+static int selftest_bc4(void)
+{
+    uint8_t blocks[8 * 16];
+    uint8_t out[8 * 16];
+    int failed = 0;
+
+    for (uint32_t pair = 0; pair < 65536 && !failed; ++pair) {
+        for (uint32_t stride = 8; stride <= 16; stride += 8) {
+            memset(blocks, 0, sizeof(blocks));
+            for (uint32_t k = 0; k < 8; ++k) {
+                uint8_t* block = blocks + k * stride;
+                uint64_t bits = 0;
+                for (uint32_t i = 0; i < 16; ++i)
+                    bits |= (uint64_t)((i + k) & 7u) << (3 * i);
+                block[0] = (uint8_t)(pair >> 8);
+                block[1] = (uint8_t)pair;
+                for (int i = 0; i < 6; ++i)
+                    block[2 + i] = (uint8_t)(bits >> (8 * i));
+            }
+            decode_bc4_blocks(blocks, stride, 8, out);
+
+            uint8_t pal[8];
+            bc4_palette(blocks, pal);
+            for (uint32_t k = 0; k < 8 && !failed; ++k) {
+                for (uint32_t i = 0; i < 16; ++i) {
+                    if (out[k * 16 + i] != pal[(i + k) & 7u]) {
+                        printf("FAIL bc4: r0=%u r1=%u index %u: %u, expected %u\n", pair >> 8, pair & 0xFFu,
+                               (i + k) & 7u, out[k * 16 + i], pal[(i + k) & 7u]);
+                        failed = 1;
+                        break;
                     }
                 }
             }
-
-            int ret = write_png_rgb8(output, w, h, img);
-            free(img);
-            free(bc);
-            return ret;
         }
+    }
+    printf("%s bc4 palette, all 65536 endpoint pairs\n", failed ? "FAIL" : "ok  ");
+    return failed;
+}
 
-        // ---------------- BC7 (98) ----------------
-        if (fmt == DXGI_FORMAT_BC7_UNORM)
-        {
-            size_t bc_bytes = (size_t)block_count * 16u;
-            uint8_t* bc = (uint8_t*)malloc(bc_bytes);
-            if (!bc) {
-                fclose(f);
-                return 1;
-            }
+static uint32_t selftest_rand(uint32_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
 
-            if (fread(bc, 1, bc_bytes, f) != bc_bytes) {
-                free(bc);
-                fclose(f);
-                return 1;
+// bc1_color_strip() (SSE2 or scalar) vs. the palette lookup, for every c0
+// against c1 equal to it, one either side of it, its complement and two
+// random values, so both block kinds and their boundary are covered. Block
+// k gives pixel i index (i + k) & 3; six blocks make one full and one
+// partial group of four, decoded at the BC1 and at the BC2/BC3 stride.
+static int selftest_bc1(void)
+{
+    uint8_t blocks[6 * 16];
+    uint8_t out[4 * 6 * 16];
+    const size_t out_stride = 6 * 16;
+    uint32_t rng = 2463534242u;
+    int failed = 0;
+
+    for (uint32_t c0 = 0; c0 < 65536 && !failed; ++c0) {
+        const uint32_t c1s[6] = { c0, (c0 - 1) & 0xFFFFu, (c0 + 1) & 0xFFFFu, ~c0 & 0xFFFFu,
+                                  selftest_rand(&rng) & 0xFFFFu, selftest_rand(&rng) & 0xFFFFu };
+        for (uint32_t stride = 8; stride <= 16; stride += 8) {
+            memset(blocks, 0, sizeof(blocks));
+            for (uint32_t k = 0; k < 6; ++k) {
+                uint8_t* block = blocks + k * stride;
+                uint32_t bits = 0;
+                for (uint32_t i = 0; i < 16; ++i)
+                    bits |= ((i + k) & 3u) << (2 * i);
+                block[0] = (uint8_t)c0;
+                block[1] = (uint8_t)(c0 >> 8);
+                block[2] = (uint8_t)c1s[k];
+                block[3] = (uint8_t)(c1s[k] >> 8);
+                memcpy(block + 4, &bits, 4);
             }
-
-            fclose(f);
-
-            uint8_t* img = (uint8_t*)malloc((size_t)w * h * 4u);
-            if (!img) {
-                free(bc);
-                return 1;
+            bc1_color_strip(blocks, stride, 6, out, out_stride);
+
+            for (uint32_t k = 0; k < 6 && !failed; ++k) {
+                uint8_t pal[4][4];
+                bc1_palette(blocks + k * stride, pal);
+                for (uint32_t i = 0; i < 16; ++i) {
+                    const uint8_t* px = out + (i / 4) * out_stride + k * 16 + (i % 4) * 4;
+                    if (memcmp(px, pal[(i + k) & 3u], 4) != 0) {
+                        printf("FAIL bc1: c0=%04x c1=%04x index %u: %u,%u,%u,%u, expected %u,%u,%u,%u\n",
+                               c0, c1s[k], (i + k) & 3u, px[0], px[1], px[2], px[3],
+                               pal[(i + k) & 3u][0], pal[(i + k) & 3u][1], pal[(i + k) & 3u][2], pal[(i + k) & 3u][3]);
+                        failed = 1;
+                        break;
+                    }
+                }
             }
+        }
+    }
+    printf("%s bc1 palette, all 65536 c0 values\n", failed ? "FAIL" : "ok  ");
+    return failed;
+}
 
-            for (uint32_t by = 0; by < blocks_y; ++by) {
-                for (uint32_t bx = 0; bx < blocks_x; ++bx) {
-                    const uint8_t* blk = bc + ((uint64_t)by * blocks_x + bx) * 16u;
-                    uint8_t rgba_block[16 * 4];
+// bc7_decode_blocks() (mode-bucketed, SSE2/AVX2 for modes 5 and 6) vs.
+// bc7_decode_block() on random blocks of every mode and invalid ones, in
+// strips that are not a multiple of the batch size.
+static int selftest_bc7(void)
+{
+    enum { STRIPS = 64, COUNT = 203 };
+    uint8_t* blocks = (uint8_t*)malloc(COUNT * 16);
+    uint8_t* image = (uint8_t*)malloc(COUNT * 16 * 4);
+    uint32_t rng = 88675123u;
+    uint32_t seen[9] = { 0 };
+    int failed = 0;
+    if (!blocks || !image) {
+        free(blocks); free(image);
+        return 1;
+    }
 
-                    bc7_decode_block(blk, rgba_block);
+    for (uint32_t s = 0; s < STRIPS && !failed; ++s) {
+        for (size_t i = 0; i < COUNT * 16; ++i)
+            blocks[i] = (uint8_t)selftest_rand(&rng);
+        for (size_t i = 0; i < COUNT * 16; i += 16) {
+            const uint32_t mode = selftest_rand(&rng) % 9; // 8: no mode bit
+            blocks[i] = mode == 8 ? 0 : (uint8_t)((blocks[i] << (mode + 1)) | (1u << mode));
+            seen[mode]++;
+        }
+        bc7_decode_blocks(blocks, COUNT, image, COUNT * 16);
+
+        for (uint32_t k = 0; k < COUNT && !failed; ++k) {
+            uint8_t want[16 * 4];
+            bc7_decode_block(blocks + k * 16, want);
+            for (uint32_t y = 0; y < 4; ++y) {
+                if (memcmp(image + y * COUNT * 16 + k * 16, want + y * 16, 16) != 0) {
+                    printf("FAIL bc7: mode byte %02x, strip %u block %u row %u\n", blocks[k * 16], s, k, y);
+                    failed = 1;
+                    break;
+                }
+            }
+        }
+    }
+    for (uint32_t m = 0; m < 9 && !failed; ++m) {
+        if (!seen[m]) {
+            printf("FAIL bc7: no mode %u blocks generated\n", m);
+            failed = 1;
+        }
+    }
+    free(blocks);
+    free(image);
+    printf("%s bc7 batch decode vs. single blocks, %u random blocks\n", failed ? "FAIL" : "ok  ", STRIPS * COUNT);
+    return failed;
+}
 
-                    for (uint32_t py = 0; py < 4; ++py) {
-                        for (uint32_t px = 0; px < 4; ++px) {
-                            uint32_t x = bx * 4 + px;
-                            uint32_t y = by * 4 + py;
-                            if (x >= w || y >= h) continue;
+// Previews vs. a box filter of the full decode, at sizes with partial edge
+// blocks, for every output layout; and the preview size rule.
+static int selftest_preview(void)
+{
+    static const uint32_t sizes[][2] = { { 202, 122 }, { 13, 7 }, { 5, 5 }, { 1, 1 }, { 3, 9 }, { 64, 32 } };
+    uint32_t rng = 12345;
+    int failed = 0;
+
+    for (size_t f = 0; f < DDS_FORMAT_COUNT + 1; ++f) {
+        // The extra pass is BC5 as X/Y
+        dds2png_options opts;
+        dds2png_options_init(&opts);
+        if (f == DDS_FORMAT_COUNT)
+            opts.bc5_output = DDS2PNG_BC5_XY;
+        const dds_format_info* src = (f == DDS_FORMAT_COUNT) ? dds_find_format(DXGI_FORMAT_BC5_UNORM) : &g_dds_formats[f];
+        const dds_format_info fi = dds_output_format(src, &opts);
+
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+            const uint32_t w = sizes[s][0], h = sizes[s][1];
+            const uint32_t bx_n = (w + 3) / 4, by_n = (h + 3) / 4;
+            const size_t row_stride = (size_t)bx_n * fi.block_bytes;
+            const size_t stride = (size_t)w * fi.bpp;
+
+            uint8_t* blocks = (uint8_t*)malloc(row_stride * by_n);
+            uint8_t* image = (uint8_t*)malloc(stride * by_n * 4);
+            uint8_t* preview = (uint8_t*)malloc((size_t)bx_n * fi.bpp);
+            if (!blocks || !image || !preview) {
+                free(blocks); free(image); free(preview);
+                return 1;
+            }
+            for (size_t i = 0; i < row_stride * by_n; ++i)
+                blocks[i] = (uint8_t)selftest_rand(&rng);
+            if (fi.dxgi == DXGI_FORMAT_BC7_UNORM) {
+                // Valid mode bytes, modes 5 and 6 (the averaged ones) often
+                for (size_t i = 0; i < row_stride * by_n; i += 16) {
+                    const uint32_t r = selftest_rand(&rng);
+                    const uint32_t mode = (r & 1) ? 5 + ((r >> 1) & 1) : (r >> 1) % 8;
+                    blocks[i] = (uint8_t)((blocks[i] << (mode + 1)) | (1u << mode));
+                }
+            }
 
-                            size_t dst = ((size_t)y * w + x) * 4u;
-                            size_t src = (py * 4 + px) * 4u;
+            for (uint32_t by = 0; by < by_n; ++by) {
+                const uint32_t rows = (h - by * 4 < 4) ? h - by * 4 : 4;
+                decode_block_row(&fi, blocks + by * row_stride, bx_n, image + (size_t)by * 4 * stride, stride, w, rows);
+            }
 
-                            img[dst + 0] = rgba_block[src + 0];
-                            img[dst + 1] = rgba_block[src + 1];
-                            img[dst + 2] = rgba_block[src + 2];
-                            img[dst + 3] = rgba_block[src + 3];
-                        }
+            for (uint32_t by = 0; by < by_n && !failed; ++by) {
+                const uint32_t rows = (h - by * 4 < 4) ? h - by * 4 : 4;
+                block_mean_row(&fi, blocks + by * row_stride, bx_n, preview, w, rows);
+
+                for (uint32_t bx = 0; bx < bx_n && !failed; ++bx) {
+                    const uint32_t cols = (w - bx * 4 < 4) ? w - bx * 4 : 4;
+                    const uint32_t n = cols * rows;
+                    uint8_t want[4];
+                    for (uint32_t c = 0; c < fi.bpp; ++c) {
+                        uint32_t sum = n / 2;
+                        for (uint32_t y = 0; y < rows; ++y)
+                            for (uint32_t x = 0; x < cols; ++x)
+                                sum += image[(size_t)(by * 4 + y) * stride + (size_t)(bx * 4 + x) * fi.bpp + c];
+                        want[c] = (uint8_t)(sum / n);
+                    }
+                    if (fi.dxgi == DXGI_FORMAT_BC5_UNORM && fi.bpp == 3) // Z from the mean X/Y
+                        want[2] = bc5_z_table()[(size_t)want[0] << 8 | want[1]];
+                    if (memcmp(want, preview + (size_t)bx * fi.bpp, fi.bpp) != 0) {
+                        printf("FAIL preview: DXGI %u bpp %u, %ux%u, block (%u, %u)\n",
+                               fi.dxgi, fi.bpp, w, h, bx, by);
+                        failed = 1;
                     }
                 }
             }
-
-            int ret = write_png_rgba8(output, w, h, img);
-            free(img);
-            free(bc);
-            return ret;
+            free(blocks);
+            free(image);
+            free(preview);
         }
+    }
 
-        // ---------------- Unsupported Format ----------------
-        fprintf(stderr,
-                "ERROR: Unsupported DXGI format %u in '%s' (BC1=71, BC2=74, BC3=77, BC4=80, BC5=83, BC7=98)\n",
-                fmt, input);
-        fclose(f);
-        return 1;
+    // A mip is only averaged when a quarter of it still meets max_dim
+    uint32_t pw = 0, ph = 0;
+    if (dds_preview_size(1, 1, 1, &pw, &ph) || pw != 1 || ph != 1 ||
+        dds_preview_size(50, 199, 122, NULL, NULL) ||
+        !dds_preview_size(50, 202, 122, &pw, &ph) || pw != 51 || ph != 31) {
+        printf("FAIL preview size rule\n");
+        failed = 1;
     }
 
-    #ifdef __cplusplus
+    printf("%s block-average previews vs. box-filtered decodes\n", failed ? "FAIL" : "ok  ");
+    return failed;
 }
-#endif
 
-// ----------------------- Optional Standalone Main -----------------------
+static int run_selftest(void)
+{
+    int failed = 0;
+    failed |= selftest_bc1();
+    failed |= selftest_bc4();
+    failed |= selftest_bc7();
+    failed |= selftest_preview();
+    return failed;
+}
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Usage: %s [options] input.dds output.png\n", argv0);
+    fprintf(stderr, "       %s [options] --bench input.dds [more.dds ...]\n", argv0);
+    fprintf(stderr, "       %s --selftest\n", argv0);
+    fprintf(stderr, "Options:\n"
+                    "  --preset fast|balanced|archive   compression preset (default: balanced)\n"
+                    "  --level 0-9                      zlib level\n"
+                    "  --strategy auto|default|filtered|huffman|rle|fixed\n"
+                    "  --mem-level 1-9                  zlib memLevel\n"
+                    "  --window-bits 9-15               zlib windowBits\n"
+                    "  --filter none|sub|up|avg|paeth|adaptive\n"
+                    "  --time-budget MS                 pick the level per image to fit MS\n"
+                    "  --bc5 rgb|xy                     BC5 as RGB with rebuilt Z, or X/Y as gray+alpha\n"
+                    "  --max-dim N                      convert the smallest mip still N pixels on its longer side\n"
+                    "  -j N                             decode and deflate with N threads\n"
+                    "  --stats                          report uniform and repeated blocks per format\n");
+}
 
-#ifdef STANDALONE
 int main(int argc, char** argv)
 {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s input.dds output.png\n", argv[0]);
+    dds2png_options opts;
+    dds2png_options_init(&opts);
+
+    int bench = 0;
+    int stats = 0;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-') {
+        if (strcmp(argv[argi], "-j") == 0) {
+            char* end = NULL;
+            long n = (argi + 1 < argc) ? strtol(argv[argi + 1], &end, 10) : 0;
+            if (n < 1 || n > DDS_MAX_THREADS || *end != '\0') {
+                fprintf(stderr, "ERROR: -j expects a thread count in 1..%d\n", DDS_MAX_THREADS);
+                return 1;
+            }
+            opts.threads = (int)n;
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--bench") == 0) {
+            bench = 1;
+            argi++;
+            continue;
+        }
+        if (strcmp(argv[argi], "--selftest") == 0)
+            return run_selftest();
+        if (strcmp(argv[argi], "--stats") == 0) {
+            stats = 1;
+            argi++;
+            continue;
+        }
+        int used = dds2png_parse_option(&opts, argv[argi], argi + 1 < argc ? argv[argi + 1] : NULL);
+        if (used <= 0) {
+            if (used == 0)
+                fprintf(stderr, "ERROR: unknown option '%s'\n", argv[argi]);
+            usage(argv[0]);
+            return 1;
+        }
+        argi += used;
+    }
+
+    int ret;
+    if (bench && argi < argc) {
+        ret = run_bench(&opts, argc - argi, argv + argi);
+    } else if (bench || argc - argi != 2) {
+        usage(argv[0]);
         return 1;
+    } else {
+        ret = dds2png_convert_ex(argv[argi], argv[argi + 1], &opts);
     }
-    return dds2png_convert(argv[1], argv[2]);
+
+    if (stats)
+        print_block_stats();
+    return ret;
 }
 #endif
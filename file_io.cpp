@@ -0,0 +1,807 @@
+// file_io.cpp
+// io_uring and blocking backends of file_io.h, and its stat and clone
+// helpers.
+
+#include "file_io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FILE_IO_HAVE_POSIX 1
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define FILE_IO_HAVE_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#if __has_include(<linux/fs.h>)
+#define FILE_IO_HAVE_CLONE 1
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#endif
+
+// Largest single read or write request (the ring takes 32-bit lengths).
+#define FILE_IO_CHUNK (1u << 30)
+
+// ----------------------- Blocking backend -----------------------
+
+namespace {
+
+#ifdef FILE_IO_HAVE_POSIX
+int readWhole(const std::string& path, FileData& f)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return errno;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+
+    f.heap.resize((size_t)st.st_size);
+    size_t got = 0;
+    while (got < f.heap.size()) {
+        size_t want = std::min(f.heap.size() - got, (size_t)FILE_IO_CHUNK);
+        ssize_t n = pread(fd, f.heap.data() + got, want, (off_t)got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            int err = n < 0 ? errno : 0;
+            close(fd);
+            if (err)
+                return err;
+            break; // shrank under us: keep what is there
+        }
+        got += (size_t)n;
+    }
+    if (got == f.heap.size())
+        close(fd);
+    f.heap.resize(got);
+    return 0;
+}
+
+int writeWhole(const std::string& path, const uint8_t* data, size_t size)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return errno;
+
+    size_t put = 0;
+    while (put < size) {
+        size_t want = std::min(size - put, (size_t)FILE_IO_CHUNK);
+        ssize_t n = pwrite(fd, data + put, want, (off_t)put);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            int err = n < 0 ? errno : EIO;
+            close(fd);
+            return err;
+        }
+        put += (size_t)n;
+    }
+    return close(fd) == 0 ? 0 : errno;
+}
+#else
+int readWhole(const std::string& path, FileData& f)
+{
+    FILE* fp = std::fopen(path.c_str(), "rb");
+    if (!fp)
+        return errno ? errno : EIO;
+    long len = -1;
+    if (std::fseek(fp, 0, SEEK_END) == 0)
+        len = std::ftell(fp);
+    int err = (len < 0 || std::fseek(fp, 0, SEEK_SET) != 0) ? EIO : 0;
+    if (!err) {
+        f.heap.resize((size_t)len);
+        if (std::fread(f.heap.data(), 1, f.heap.size(), fp) != f.heap.size())
+            err = EIO;
+    }
+    std::fclose(fp);
+    return err;
+}
+
+int writeWhole(const std::string& path, const uint8_t* data, size_t size)
+{
+    FILE* fp = std::fopen(path.c_str(), "wb");
+    if (!fp)
+        return errno ? errno : EIO;
+    int err = std::fwrite(data, 1, size, fp) == size ? 0 : EIO;
+    if (std::fclose(fp) != 0)
+        err = EIO;
+    return err;
+}
+#endif
+
+class BlockingFileIO : public FileIO {
+public:
+    const char* name() const override { return "blocking"; }
+    int readerThreads() const override { return 2; }
+
+    void readAll(const std::function<bool(FileData&, bool)>& next,
+                 const std::function<void(FileData&&)>& done) override
+    {
+        for (;;) {
+            FileData f;
+            if (!next(f, true))
+                return;
+            f.error = readWhole(*f.path, f);
+            f.data = f.heap.data();
+            f.size = f.heap.size();
+            done(std::move(f));
+        }
+    }
+
+    void writeAll(const std::function<bool(FileData&, bool)>& next,
+                  const std::function<void(FileData&&)>& done) override
+    {
+        FileData f;
+        while (next(f, true)) {
+            f.error = writeWhole(*f.path, f.data, f.size);
+            done(std::move(f));
+            f = FileData();
+        }
+    }
+
+    void release(int) override {}
+};
+
+} // namespace
+
+std::unique_ptr<FileIO> makeBlockingFileIO()
+{
+    return std::unique_ptr<FileIO>(new BlockingFileIO());
+}
+
+#ifdef FILE_IO_HAVE_POSIX
+static void fromStat(const struct stat& st, FileStat& out)
+{
+    out.size = (uint64_t)st.st_size;
+#if defined(__APPLE__)
+    out.mtimeNs = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    out.mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    out.dev = (uint64_t)st.st_dev;
+    out.ino = (uint64_t)st.st_ino;
+}
+
+bool statFile(const std::string& path, FileStat& out)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+    fromStat(st, out);
+    return true;
+}
+
+bool statFileTail(const std::string& path, FileStat& out, uint8_t* tail, size_t n)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && (uint64_t)st.st_size >= n &&
+              pread(fd, tail, n, (off_t)(st.st_size - (off_t)n)) == (ssize_t)n;
+    close(fd);
+    if (ok)
+        fromStat(st, out);
+    return ok;
+}
+#else
+bool statFile(const std::string& path, FileStat& out)
+{
+    std::error_code ec;
+    out.size = (uint64_t)std::filesystem::file_size(path, ec);
+    if (ec)
+        return false;
+    auto t = std::filesystem::last_write_time(path, ec);
+    if (ec)
+        return false;
+    out.mtimeNs = (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    out.dev = out.ino = 0;
+    return true;
+}
+
+bool statFileTail(const std::string& path, FileStat& out, uint8_t* tail, size_t n)
+{
+    if (!statFile(path, out) || out.size < n)
+        return false;
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    bool ok = std::fseek(f, -(long)n, SEEK_END) == 0 && std::fread(tail, 1, n, f) == n;
+    std::fclose(f);
+    return ok;
+}
+#endif
+
+FileClone cloneFile(const std::string& from, const std::string& to, bool reflink, bool hardlink)
+{
+#if defined(FILE_IO_HAVE_CLONE) && defined(FICLONE)
+    if (reflink) {
+        int src = open(from.c_str(), O_RDONLY);
+        if (src >= 0) {
+            int dst = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+            bool cloned = dst >= 0 && ioctl(dst, FICLONE, src) == 0;
+            if (dst >= 0 && (close(dst) != 0 || !cloned)) {
+                unlink(to.c_str());
+                cloned = false;
+            }
+            close(src);
+            if (cloned)
+                return FileClone::Reflink;
+        }
+    }
+#else
+    (void)reflink;
+#endif
+
+    std::error_code ec;
+    if (hardlink) {
+        std::filesystem::create_hard_link(from, to, ec);
+        if (!ec)
+            return FileClone::Hardlink;
+    }
+    if (std::filesystem::copy_file(from, to, ec))
+        return FileClone::Copy;
+    std::filesystem::remove(to, ec);
+    return FileClone::Failed;
+}
+
+// ----------------------- io_uring backend -----------------------
+//
+// Talks to the kernel through the raw syscalls, so there is no liburing
+// dependency. Each file is a small state machine (open, then reads or writes
+// until done, then close) with exactly one request on the ring at a time;
+// the request's user_data is the index of the file's slot in `ops`.
+
+#ifdef FILE_IO_HAVE_URING
+
+namespace {
+
+// Registered buffers: files up to URING_SLOT_SIZE bytes are read with
+// READ_FIXED into one of these; larger ones (or any once all are taken) go
+// to a heap buffer with a plain READ.
+#define URING_SLOT_SIZE  (1u << 20)
+#define URING_MAX_SLOTS  32u
+
+class Ring {
+public:
+    ~Ring()
+    {
+        if (sqes)
+            munmap(sqes, sqesBytes);
+        if (cqMap && cqMap != sqMap)
+            munmap(cqMap, cqBytes);
+        if (sqMap)
+            munmap(sqMap, sqBytes);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool init(unsigned entries)
+    {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0)
+            return false;
+
+        sqBytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqBytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            sqBytes = cqBytes = std::max(sqBytes, cqBytes);
+
+        sqMap = mmap(nullptr, sqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqMap == MAP_FAILED) {
+            sqMap = nullptr;
+            return false;
+        }
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            cqMap = sqMap;
+        } else {
+            cqMap = mmap(nullptr, cqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqMap == MAP_FAILED) {
+                cqMap = nullptr;
+                return false;
+            }
+        }
+        sqesBytes = p.sq_entries * sizeof(io_uring_sqe);
+        void* s = mmap(nullptr, sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (s == MAP_FAILED)
+            return false;
+        sqes = (io_uring_sqe*)s;
+
+        uint8_t* sq = (uint8_t*)sqMap;
+        sqTail  = (unsigned*)(sq + p.sq_off.tail);
+        sqMask  = *(unsigned*)(sq + p.sq_off.ring_mask);
+        sqArray = (unsigned*)(sq + p.sq_off.array);
+        uint8_t* cq = (uint8_t*)cqMap;
+        cqHead  = (unsigned*)(cq + p.cq_off.head);
+        cqTail  = (unsigned*)(cq + p.cq_off.tail);
+        cqMask  = *(unsigned*)(cq + p.cq_off.ring_mask);
+        cqes    = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    // Whether the kernel has all `count` opcodes. The probe itself is 5.6+,
+    // as are OPENAT and CLOSE; older rings set up fine and then fail them.
+    bool supports(const uint8_t* opcodes, size_t count)
+    {
+        const unsigned n = 256;
+        std::vector<uint8_t> mem(sizeof(io_uring_probe) + n * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = (io_uring_probe*)mem.data();
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, n) != 0)
+            return false;
+        for (size_t i = 0; i < count; i++) {
+            if (opcodes[i] > probe->last_op || !(probe->ops[opcodes[i]].flags & IO_URING_OP_SUPPORTED))
+                return false;
+        }
+        return true;
+    }
+
+    bool registerBuffers(const iovec* iov, unsigned count)
+    {
+        return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, count) == 0;
+    }
+
+    // Next free SQE, zeroed (the caller never queues more than the ring holds).
+    io_uring_sqe* get()
+    {
+        unsigned tail = *sqTail + pending;
+        unsigned index = tail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        pending++;
+        return sqe;
+    }
+
+    // Submit what get() queued and wait for at least `wait` completions.
+    int submit(unsigned wait)
+    {
+        __atomic_store_n(sqTail, *sqTail + pending, __ATOMIC_RELEASE);
+        unsigned toSubmit = pending;
+        pending = 0;
+        for (;;) {
+            long r = syscall(__NR_io_uring_enter, fd, toSubmit, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (r >= 0 || errno != EINTR)
+                return r < 0 ? -errno : 0;
+            toSubmit = 0;
+        }
+    }
+
+    bool pop(io_uring_cqe& out)
+    {
+        unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+            return false;
+        out = cqes[head & cqMask];
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    int fd = -1;
+    void* sqMap = nullptr;
+    void* cqMap = nullptr;
+    size_t sqBytes = 0, cqBytes = 0, sqesBytes = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned pending = 0;
+};
+
+class UringFileIO : public FileIO {
+public:
+    explicit UringFileIO(unsigned depth) : depth(depth) {}
+
+    ~UringFileIO() override
+    {
+        for (uint8_t* b : slotMem)
+            std::free(b);
+    }
+
+    // Rings are per stage thread; this one only probes that setup works and
+    // has the opcodes used here, and allocates the registered buffers the
+    // read ring will use.
+    bool init()
+    {
+        static const uint8_t used[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED,
+                                        IORING_OP_WRITE, IORING_OP_CLOSE };
+        Ring probe;
+        if (!probe.init(depth) || !probe.supports(used, sizeof(used)))
+            return false;
+
+        unsigned slots = std::min(depth, URING_MAX_SLOTS);
+        for (unsigned i = 0; i < slots; i++) {
+            void* p = nullptr;
+            if (posix_memalign(&p, 4096, URING_SLOT_SIZE) != 0)
+                break;
+            slotMem.push_back((uint8_t*)p);
+            freeSlots.push_back((int)i);
+        }
+        return true;
+    }
+
+    const char* name() const override { return "io_uring"; }
+    int readerThreads() const override { return 1; }
+
+    void readAll(const std::function<bool(FileData&, bool)>& next,
+                 const std::function<void(FileData&&)>& done) override;
+    void writeAll(const std::function<bool(FileData&, bool)>& next,
+                  const std::function<void(FileData&&)>& done) override;
+
+    void release(int slot) override
+    {
+        if (slot < 0)
+            return;
+        std::lock_guard<std::mutex> lk(slotMutex);
+        freeSlots.push_back(slot);
+    }
+
+private:
+    enum Phase { Idle, Open, Transfer, Close };
+
+    struct Op {
+        Phase phase = Idle;
+        int fd = -1;
+        size_t done = 0;     // bytes transferred
+        bool queued = false; // a request waits for the next submit
+        bool onRing = false; // a submitted request has not completed
+        FileData file;
+    };
+
+    // Requests queued since the last submit are on the ring once it succeeds.
+    static void submitted(std::vector<Op>& ops)
+    {
+        for (Op& op : ops) {
+            if (op.queued) {
+                op.queued = false;
+                op.onRing = true;
+            }
+        }
+    }
+
+    void abandon(Ring& ring, std::vector<Op>& ops, bool write,
+                 const std::function<void(FileData&&)>& done);
+
+    int takeSlot()
+    {
+        std::lock_guard<std::mutex> lk(slotMutex);
+        if (!registered || freeSlots.empty())
+            return -1;
+        int s = freeSlots.back();
+        freeSlots.pop_back();
+        return s;
+    }
+
+    void queueTransfer(Ring& ring, unsigned index, Op& op, bool write)
+    {
+        io_uring_sqe* sqe = ring.get();
+        const size_t want = std::min(op.file.size - op.done, (size_t)FILE_IO_CHUNK);
+        sqe->fd = op.fd;
+        sqe->off = op.done;
+        sqe->len = (unsigned)want;
+        sqe->user_data = index;
+        op.queued = true;
+        if (write) {
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->addr = (uint64_t)(uintptr_t)(op.file.data + op.done);
+        } else if (op.file.slot >= 0) {
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->addr = (uint64_t)(uintptr_t)(slotMem[op.file.slot] + op.done);
+            sqe->buf_index = (uint16_t)op.file.slot;
+        } else {
+            sqe->opcode = IORING_OP_READ;
+            sqe->addr = (uint64_t)(uintptr_t)(op.file.heap.data() + op.done);
+        }
+        op.phase = Transfer;
+    }
+
+    void queueOpen(Ring& ring, unsigned index, Op& op, bool write)
+    {
+        io_uring_sqe* sqe = ring.get();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)op.file.path->c_str();
+        sqe->open_flags = write ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+        sqe->len = write ? 0644 : 0;
+        sqe->user_data = index;
+        op.queued = true;
+        op.phase = Open;
+    }
+
+    void queueClose(Ring& ring, unsigned index, Op& op)
+    {
+        io_uring_sqe* sqe = ring.get();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = op.fd;
+        sqe->user_data = index;
+        op.queued = true;
+        op.phase = Close;
+    }
+
+    // Advance one file on a completion; returns true once it is finished.
+    bool step(Ring& ring, unsigned index, Op& op, int res, bool write)
+    {
+        switch (op.phase) {
+        case Open:
+            if (res < 0) {
+                op.file.error = -res;
+                return true;
+            }
+            op.fd = res;
+            if (!write) {
+                // Sized now, not from the scan: the file may have changed
+                struct stat st;
+                if (fstat(op.fd, &st) != 0) {
+                    op.file.error = errno;
+                    queueClose(ring, index, op);
+                    return false;
+                }
+                op.file.size = (size_t)st.st_size;
+                op.file.slot = op.file.size <= URING_SLOT_SIZE ? takeSlot() : -1;
+                if (op.file.slot < 0)
+                    op.file.heap.resize(op.file.size);
+            }
+            if (op.file.size == 0) {
+                queueClose(ring, index, op);
+                return false;
+            }
+            queueTransfer(ring, index, op, write);
+            return false;
+        case Transfer:
+            if (res < 0 || (res == 0 && write)) {
+                op.file.error = res < 0 ? -res : EIO;
+            } else if (res == 0) {
+                op.file.size = op.done; // shorter than the scan saw
+            } else {
+                op.done += (size_t)res;
+                if (op.done < op.file.size) {
+                    queueTransfer(ring, index, op, write);
+                    return false;
+                }
+            }
+            queueClose(ring, index, op);
+            return false;
+        case Close:
+            if (res < 0 && !op.file.error && write)
+                op.file.error = -res;
+            return true;
+        default:
+            return true;
+        }
+    }
+
+    unsigned depth;
+    std::vector<uint8_t*> slotMem;
+    std::mutex slotMutex;
+    std::vector<int> freeSlots;
+    bool registered = false;
+};
+
+void UringFileIO::readAll(const std::function<bool(FileData&, bool)>& next,
+                          const std::function<void(FileData&&)>& done)
+{
+    Ring ring;
+    if (!ring.init(depth)) {
+        makeBlockingFileIO()->readAll(next, done);
+        return;
+    }
+
+    if (!slotMem.empty()) {
+        std::vector<iovec> iov(slotMem.size());
+        for (size_t i = 0; i < slotMem.size(); i++) {
+            iov[i].iov_base = slotMem[i];
+            iov[i].iov_len = URING_SLOT_SIZE;
+        }
+        // Pinning can be refused (RLIMIT_MEMLOCK); plain reads still work.
+        std::lock_guard<std::mutex> lk(slotMutex);
+        registered = ring.registerBuffers(iov.data(), (unsigned)iov.size());
+    }
+
+    std::vector<Op> ops(depth);
+    std::vector<unsigned> idle;
+    for (unsigned i = depth; i-- > 0; )
+        idle.push_back(i);
+
+    bool more = true;
+    unsigned inFlight = 0;
+    for (;;) {
+        // Only block for new work when nothing is in flight.
+        while (more && !idle.empty()) {
+            unsigned index = idle.back();
+            Op& op = ops[index];
+            op = Op();
+            if (!next(op.file, inFlight == 0)) {
+                if (inFlight == 0)
+                    more = false;
+                break;
+            }
+            idle.pop_back();
+            inFlight++;
+            queueOpen(ring, index, op, false);
+        }
+        if (!inFlight)
+            break;
+
+        int err = ring.submit(1);
+        if (err < 0) {
+            std::fprintf(stderr, "WARNING: io_uring_enter failed (%s), reading with blocking I/O\n", std::strerror(-err));
+            abandon(ring, ops, false, done);
+            if (more)
+                makeBlockingFileIO()->readAll(next, done);
+            return;
+        }
+        submitted(ops);
+
+        io_uring_cqe cqe;
+        while (ring.pop(cqe)) {
+            unsigned index = (unsigned)cqe.user_data;
+            Op& op = ops[index];
+            op.onRing = false;
+            if (!step(ring, index, op, cqe.res, false))
+                continue;
+
+            if (op.file.slot >= 0)
+                op.file.data = slotMem[op.file.slot];
+            else
+                op.file.data = op.file.heap.data();
+            if (op.file.error) {
+                release(op.file.slot);
+                op.file.slot = -1;
+                op.file.data = nullptr;
+                op.file.size = 0;
+            }
+            done(std::move(op.file));
+            op.phase = Idle;
+            idle.push_back(index);
+            inFlight--;
+        }
+    }
+}
+
+void UringFileIO::writeAll(const std::function<bool(FileData&, bool)>& next,
+                           const std::function<void(FileData&&)>& done)
+{
+    Ring ring;
+    if (!ring.init(depth)) {
+        makeBlockingFileIO()->writeAll(next, done);
+        return;
+    }
+
+    std::vector<Op> ops(depth);
+    std::vector<unsigned> idle;
+    for (unsigned i = depth; i-- > 0; )
+        idle.push_back(i);
+
+    bool more = true;
+    unsigned inFlight = 0;
+    for (;;) {
+        // Only block for new work when nothing is in flight.
+        while (more && !idle.empty()) {
+            unsigned index = idle.back();
+            Op& op = ops[index];
+            op = Op();
+            if (!next(op.file, inFlight == 0)) {
+                if (inFlight == 0)
+                    more = false;
+                break;
+            }
+            idle.pop_back();
+            inFlight++;
+            queueOpen(ring, index, op, true);
+        }
+        if (!inFlight)
+            break;
+
+        int err = ring.submit(1);
+        if (err < 0) {
+            std::fprintf(stderr, "WARNING: io_uring_enter failed (%s), writing with blocking I/O\n", std::strerror(-err));
+            abandon(ring, ops, true, done);
+            if (more)
+                makeBlockingFileIO()->writeAll(next, done);
+            return;
+        }
+        submitted(ops);
+
+        io_uring_cqe cqe;
+        while (ring.pop(cqe)) {
+            unsigned index = (unsigned)cqe.user_data;
+            Op& op = ops[index];
+            op.onRing = false;
+            if (!step(ring, index, op, cqe.res, true))
+                continue;
+            done(std::move(op.file));
+            op.phase = Idle;
+            idle.push_back(index);
+            inFlight--;
+        }
+    }
+}
+
+// The ring failed to submit. The requests already on it still use the files'
+// buffers and descriptors, so wait for them to complete (their completions
+// need no io_uring_enter), then redo every file in flight with the blocking
+// backend.
+void UringFileIO::abandon(Ring& ring, std::vector<Op>& ops, bool write,
+                          const std::function<void(FileData&&)>& done)
+{
+    for (;;) {
+        io_uring_cqe cqe;
+        while (ring.pop(cqe)) {
+            Op& op = ops[(unsigned)cqe.user_data];
+            op.onRing = false;
+            if (op.phase == Open && cqe.res >= 0)
+                op.fd = cqe.res;
+            else if (op.phase == Close)
+                op.fd = -1;
+        }
+        if (std::none_of(ops.begin(), ops.end(), [](const Op& op) { return op.onRing; }))
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    for (Op& op : ops) {
+        if (op.phase == Idle)
+            continue;
+        if (op.fd >= 0)
+            close(op.fd);
+        release(op.file.slot);
+        op.file.slot = -1;
+        if (write) {
+            op.file.error = writeWhole(*op.file.path, op.file.data, op.file.size);
+        } else {
+            op.file.error = readWhole(*op.file.path, op.file);
+            op.file.data = op.file.heap.data();
+            op.file.size = op.file.heap.size();
+        }
+        done(std::move(op.file));
+        op = Op();
+    }
+}
+
+} // namespace
+
+std::unique_ptr<FileIO> makeUringFileIO(unsigned depth)
+{
+    std::unique_ptr<UringFileIO> io(new UringFileIO(depth));
+    if (!io->init())
+        return nullptr;
+    return std::unique_ptr<FileIO>(io.release());
+}
+
+#else
+
+std::unique_ptr<FileIO> makeUringFileIO(unsigned)
+{
+    return nullptr;
+}
+
+#endif
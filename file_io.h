@@ -0,0 +1,84 @@
+// file_io.h
+// Whole-file reads and writes for batch_dds2png's pipeline stages.
+//
+// Two backends behind one interface: io_uring (Linux), where one thread keeps
+// up to `depth` files in flight (open, read/write and close are all queued
+// on the ring) and small files are read into registered buffers; and a
+// blocking open/pread/pwrite/close fallback, used when io_uring is missing
+// or refused (old kernel, seccomp), when a ring fails during a run, and on
+// other platforms. Also the stat and
+// copy helpers the batch converter needs beyond std::filesystem.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One file's contents on its way through the pipeline.
+struct FileData {
+    size_t job = 0;
+    const std::string* path = nullptr;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    int slot = -1;              // registered buffer holding data, or -1
+    std::vector<uint8_t> heap;  // holds data when slot is -1
+    int error = 0;              // errno of a failed read or write
+};
+
+class FileIO {
+public:
+    virtual ~FileIO() = default;
+
+    virtual const char* name() const = 0;
+
+    // Threads the read stage should run readAll() on.
+    virtual int readerThreads() const = 0;
+
+    // Read the files next() returns, handing each to done() as it completes
+    // (in any order); FileData::error is set on failure. next(f, wait) may
+    // block for a file only when wait is true; it returns false when none is
+    // ready (or, when waiting, when there are no more).
+    virtual void readAll(const std::function<bool(FileData&, bool)>& next,
+                         const std::function<void(FileData&&)>& done) = 0;
+
+    // Write the files next() returns, with next() as for readAll(). done()
+    // reports each result.
+    virtual void writeAll(const std::function<bool(FileData&, bool)>& next,
+                          const std::function<void(FileData&&)>& done) = 0;
+
+    // Give back the registered buffer of a file handed out by readAll().
+    virtual void release(int slot) = 0;
+};
+
+// The io_uring backend with `depth` files in flight, or nullptr when the
+// kernel does not offer io_uring.
+std::unique_ptr<FileIO> makeUringFileIO(unsigned depth);
+
+std::unique_ptr<FileIO> makeBlockingFileIO();
+
+struct FileStat {
+    uint64_t size = 0;
+    int64_t mtimeNs = 0; // for comparing with an earlier statFile() only
+    uint64_t dev = 0;    // dev and ino identify the file (hardlinks share
+    uint64_t ino = 0;    // them); both 0 where the platform has no inodes
+};
+
+// Stat `path` once; false if it cannot be stat'ed.
+bool statFile(const std::string& path, FileStat& st);
+
+// statFile() and the last `n` bytes of `path`, through one open; false if
+// it cannot be read or is shorter than `n`.
+bool statFileTail(const std::string& path, FileStat& st, uint8_t* tail, size_t n);
+
+// How cloneFile() made its copy.
+enum class FileClone { Reflink, Hardlink, Copy, Failed };
+
+// Make `to` (which must not exist) hold the contents of `from`: a reflink
+// sharing the data blocks (copy-on-write file systems on Linux) when
+// `reflink`, else a hardlink when `hardlink`, else a plain copy, falling
+// back along that order when one is not possible.
+FileClone cloneFile(const std::string& from, const std::string& to, bool reflink, bool hardlink);
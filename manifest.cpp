@@ -0,0 +1,218 @@
+// manifest.cpp
+// Incremental-conversion manifest of manifest.h.
+
+#include "manifest.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+// Both files: this header, then records until the end of the file.
+static const char MANIFEST_MAGIC[4] = { 'D', '2', 'P', 'M' };
+#define MANIFEST_VERSION 3u
+
+#pragma pack(push, 1)
+struct ManifestRecord {
+    uint16_t keyLen; // key bytes follow the record
+    uint64_t ddsSize;
+    int64_t ddsMtime;
+    uint32_t ddsCrc;
+    uint64_t pngSize;
+    int64_t pngMtime;
+    uint32_t settings;
+    uint32_t flags;
+};
+#pragma pack(pop)
+
+static bool writeHeader(FILE* f)
+{
+    uint32_t version = MANIFEST_VERSION;
+    return std::fwrite(MANIFEST_MAGIC, 1, 4, f) == 4 && std::fwrite(&version, 4, 1, f) == 1;
+}
+
+static bool readHeader(FILE* f)
+{
+    char magic[4];
+    uint32_t version = 0;
+    return std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, MANIFEST_MAGIC, 4) == 0 &&
+           std::fread(&version, 4, 1, f) == 1 && version == MANIFEST_VERSION;
+}
+
+static bool writeRecord(FILE* f, const std::string& key, const ManifestEntry& e)
+{
+    ManifestRecord r;
+    r.keyLen = (uint16_t)key.size();
+    r.ddsSize = e.ddsSize;
+    r.ddsMtime = e.ddsMtime;
+    r.ddsCrc = e.ddsCrc;
+    r.pngSize = e.pngSize;
+    r.pngMtime = e.pngMtime;
+    r.settings = e.settings;
+    r.flags = e.flags;
+    return std::fwrite(&r, sizeof(r), 1, f) == 1 && std::fwrite(key.data(), 1, key.size(), f) == key.size();
+}
+
+// False at the end of the file or at a torn record (an interrupted append).
+static bool readRecord(FILE* f, std::string& key, ManifestEntry& e)
+{
+    ManifestRecord r;
+    if (std::fread(&r, sizeof(r), 1, f) != 1)
+        return false;
+    key.resize(r.keyLen);
+    if (r.keyLen && std::fread(&key[0], 1, r.keyLen, f) != r.keyLen)
+        return false;
+    e.ddsSize = r.ddsSize;
+    e.ddsMtime = r.ddsMtime;
+    e.ddsCrc = r.ddsCrc;
+    e.pngSize = r.pngSize;
+    e.pngMtime = r.pngMtime;
+    e.settings = r.settings;
+    e.flags = r.flags;
+    return true;
+}
+
+// Add the records of `file` to `out`, later ones replacing earlier ones.
+// False if the file does not exist or is of another version.
+static bool readInto(const fs::path& file, std::unordered_map<std::string, ManifestEntry>& out)
+{
+    FILE* f = std::fopen(file.string().c_str(), "rb");
+    if (!f)
+        return false;
+    bool ok = readHeader(f);
+    if (ok) {
+        std::string key;
+        ManifestEntry e;
+        while (readRecord(f, key, e))
+            out[key] = e;
+    }
+    std::fclose(f);
+    return ok;
+}
+
+Manifest::~Manifest()
+{
+    if (journal)
+        std::fclose(journal);
+}
+
+bool Manifest::load(const fs::path& root, const char* name)
+{
+    path = root / name;
+    journalPath = root / (std::string(name) + ".journal");
+    bool found = readInto(path, loaded);
+    if (readInto(journalPath, loaded)) {
+        // Left by an interrupted run, maybe with a torn last record: fold it
+        // in now so this run's journal starts clean.
+        std::error_code ec;
+        if (writeManifest(loaded))
+            fs::remove(journalPath, ec);
+        else
+            journalFailed = true;
+        found = true;
+    }
+    return found;
+}
+
+const ManifestEntry* Manifest::find(const std::string& key) const
+{
+    auto it = loaded.find(key);
+    return it == loaded.end() ? nullptr : &it->second;
+}
+
+void Manifest::keep(const std::string& key, const ManifestEntry& e)
+{
+    std::lock_guard<std::mutex> lk(m);
+    current[key] = e;
+}
+
+void Manifest::record(const std::string& key, const ManifestEntry& e)
+{
+    std::lock_guard<std::mutex> lk(m);
+    current[key] = e;
+    if (journalFailed || key.size() > 0xFFFF)
+        return;
+
+    if (!journal) {
+        journal = std::fopen(journalPath.string().c_str(), "wb");
+        if (journal && !writeHeader(journal)) {
+            std::fclose(journal);
+            journal = nullptr;
+        }
+        if (!journal) {
+            std::cout << "\nWARNING: cannot write '" << journalPath.string()
+                      << "'; an interrupted run will redo its conversions\n";
+            journalFailed = true;
+            return;
+        }
+    }
+    // Flushed per record: a crash loses at most the record being written
+    writeRecord(journal, key, e);
+    std::fflush(journal);
+}
+
+// Write to a temporary file and rename it over the manifest.
+bool Manifest::writeManifest(const std::unordered_map<std::string, ManifestEntry>& entries)
+{
+    fs::path tmp = path;
+    tmp += ".tmp";
+    FILE* f = std::fopen(tmp.string().c_str(), "wb");
+    bool ok = f && writeHeader(f);
+    for (auto it = entries.begin(); ok && it != entries.end(); ++it) {
+        if (it->first.size() <= 0xFFFF)
+            ok = writeRecord(f, it->first, it->second);
+    }
+    if (f && std::fclose(f) != 0)
+        ok = false;
+
+    std::error_code ec;
+    if (ok)
+        fs::rename(tmp, path, ec);
+    if (!ok || ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool Manifest::save()
+{
+    std::lock_guard<std::mutex> lk(m);
+    if (!writeManifest(current))
+        return false;
+
+    std::error_code ec;
+    if (journal) {
+        std::fclose(journal);
+        journal = nullptr;
+    }
+    fs::remove(journalPath, ec);
+    return true;
+}
+
+uint32_t manifestSettings(const dds2png_options& opts)
+{
+    // Threads and the parallel hook only change the deflate segmentation,
+    // not the image, and are left out.
+    struct {
+        uint32_t version;
+        int32_t level, strategy, memLevel, windowBits, filter, bc5Output;
+        double timeBudgetMs;
+    } s;
+    std::memset(&s, 0, sizeof(s));
+    s.version = MANIFEST_VERSION;
+    s.level = opts.level;
+    s.strategy = opts.strategy;
+    s.memLevel = opts.mem_level;
+    s.windowBits = opts.window_bits;
+    s.filter = opts.filter;
+    s.bc5Output = opts.bc5_output;
+    s.timeBudgetMs = opts.time_budget_ms;
+    uLong crc = crc32(0L, (const Bytef*)&s, sizeof(s));
+    // Thumbnails are another image; full-size runs keep their fingerprint
+    if (opts.max_dim)
+        crc = crc32(crc, (const Bytef*)&opts.max_dim, sizeof(opts.max_dim));
+    return (uint32_t)crc;
+}
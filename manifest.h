@@ -0,0 +1,74 @@
+// manifest.h
+// Per-root record of what batch_dds2png has converted, for incremental runs.
+//
+// <root>/.dds2png-manifest holds one entry per DDS: its root-relative path,
+// size, mtime and crc32, its PNG's size and mtime, and a fingerprint of the
+// settings the PNG was made with; thumbnail runs keep their own in
+// <root>/.dds2png-thumbs. Entries that change during a run are appended to
+// the manifest's name plus .journal as soon as they do, so an
+// interrupted run loses nothing: the next load() replays the journal, and
+// save() folds everything into a fresh manifest and drops the journal.
+// Both files are a local cache in native byte order.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "dds2png.h"
+
+#define MANIFEST_HASHED 1u // ddsCrc is known
+
+#define MANIFEST_FULL   ".dds2png-manifest" // full-size PNGs
+#define MANIFEST_THUMBS ".dds2png-thumbs"   // --max-dim thumbnails
+
+struct ManifestEntry {
+    uint64_t ddsSize = 0;
+    int64_t ddsMtime = 0;  // as from statFile()
+    uint32_t ddsCrc = 0;
+    uint64_t pngSize = 0;
+    int64_t pngMtime = 0;  // as from statFile()
+    uint32_t settings = 0; // manifestSettings() of the conversion
+    uint32_t flags = 0;    // MANIFEST_*
+};
+
+class Manifest {
+public:
+    ~Manifest();
+
+    // Read root's manifest `name` (MANIFEST_FULL or MANIFEST_THUMBS) and
+    // replay its journal. Returns false when the root has neither yet, or
+    // only ones of another version.
+    bool load(const std::filesystem::path& root, const char* name);
+
+    // Entry as loaded, or nullptr. Safe from any thread after load().
+    const ManifestEntry* find(const std::string& key) const;
+
+    // Carry a loaded entry unchanged into the next manifest.
+    void keep(const std::string& key, const ManifestEntry& e);
+
+    // A new or changed entry: journaled now and saved in the next manifest.
+    void record(const std::string& key, const ManifestEntry& e);
+
+    // Replace the manifest with the entries kept and recorded since load()
+    // (files not seen this run drop out) and remove the journal. Returns
+    // false, leaving manifest and journal as they were, on failure.
+    bool save();
+
+private:
+    bool writeManifest(const std::unordered_map<std::string, ManifestEntry>& entries);
+
+    std::filesystem::path path, journalPath;
+    std::unordered_map<std::string, ManifestEntry> loaded;
+    std::mutex m; // guards current and journal
+    std::unordered_map<std::string, ManifestEntry> current;
+    FILE* journal = nullptr;
+    bool journalFailed = false;
+};
+
+// Fingerprint of the options that change the PNG bytes.
+uint32_t manifestSettings(const dds2png_options& opts);